@@ -0,0 +1,312 @@
+/*
+ * cache.c -- implements a bounded cache as a hash table of nodes that
+ * are also linked, through queue handles, into a recency list.
+ *
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <queue.h>
+#include <hash.h>
+#include <cache.h>
+
+#define KEYBUFSIZE 64		/* keys this size are encoded on the stack */
+
+
+/* PRIVATE SECTION */
+
+/*
+ * A node holds a cached element together with its key. The key is
+ * stored length-prefixed (ekey) so that the search function, which
+ * only sees the key pointer, can compare keys of different lengths;
+ * the same encoding is what gets hashed.
+ */
+typedef struct {
+  void *elementp;		/* the cached element */
+  qhandle_t *qh;		/* position in the recency list */
+  uint64_t size;		/* bytes charged to the element */
+  bool referenced;		/* CLOCK reference bit */
+  char ekey[];			/* int32_t keylen followed by the key */
+} cnode_t;
+
+/* the hidden structure of a cache */
+typedef struct {
+  hashtable_t *table;		/* key -> node */
+  queue_t *recency;		/* nodes, least recently used first */
+  int policy;			/* CACHE_LRU or CACHE_CLOCK */
+  uint64_t maxentries;		/* limits (0 = unlimited) */
+  uint64_t maxbytes;
+  uint64_t entries;		/* current usage */
+  uint64_t bytes;
+  uint64_t hits;		/* statistics */
+  uint64_t misses;
+  void (*evictfn)(void *ep);	/* releases evicted elements */
+} hcache_t;
+
+/* accessor macros */
+#define ctable(cp) (((hcache_t*)cp)->table)
+#define crecency(cp) (((hcache_t*)cp)->recency)
+#define cpolicy(cp) (((hcache_t*)cp)->policy)
+#define cmaxentries(cp) (((hcache_t*)cp)->maxentries)
+#define cmaxbytes(cp) (((hcache_t*)cp)->maxbytes)
+#define centries(cp) (((hcache_t*)cp)->entries)
+#define cbytes(cp) (((hcache_t*)cp)->bytes)
+#define chits(cp) (((hcache_t*)cp)->hits)
+#define cmisses(cp) (((hcache_t*)cp)->misses)
+#define cevictfn(cp) (((hcache_t*)cp)->evictfn)
+
+#define ekeylen(keylen) ((int32_t)sizeof(int32_t)+(keylen))
+
+/*
+ * hidden helper functions
+ */
+
+/* encode key into buf if it fits, otherwise into malloc'd space */
+static char *encode_key(char *buf, const char *key, int32_t keylen) {
+  char *ekey;
+
+  if(ekeylen(keylen) <= KEYBUFSIZE)
+    ekey = buf;
+  else
+    ekey = malloc(ekeylen(keylen));
+  if(ekey) {
+    memcpy(ekey, &keylen, sizeof(int32_t));
+    memcpy(ekey+sizeof(int32_t), key, keylen);
+  }
+  return ekey;
+}
+
+static void release_key(char *buf, char *ekey) {
+  if(ekey != buf)
+    free(ekey);
+}
+
+/* search function comparing a node with an encoded key */
+static bool is_key(void *ep, const void *searchkeyp) {
+  cnode_t *np = (cnode_t*)ep;
+  int32_t len1, len2;
+
+  memcpy(&len1, np->ekey, sizeof(int32_t));
+  memcpy(&len2, searchkeyp, sizeof(int32_t));
+  return len1 == len2 &&
+    memcmp(np->ekey, searchkeyp, ekeylen(len1)) == 0;
+}
+
+/* key function letting the table rehash nodes (see hsetkeyfn) */
+static const char *node_key(void *ep, int32_t *keylenp) {
+  cnode_t *np = (cnode_t*)ep;
+  int32_t keylen;
+
+  memcpy(&keylen, np->ekey, sizeof(int32_t));
+  *keylenp = ekeylen(keylen);
+  return np->ekey;
+}
+
+static void release_element(hcache_t *cp, void *ep) {
+  if(cevictfn(cp) != NULL)
+    (*cevictfn(cp))(ep);
+  else
+    free(ep);
+}
+
+/* take node np out of both the table and the recency list */
+static void drop_node(hcache_t *cp, cnode_t *np) {
+  int32_t keylen;
+
+  memcpy(&keylen, np->ekey, sizeof(int32_t));
+  hremove(ctable(cp), is_key, np->ekey, ekeylen(keylen));
+  qremove_handle(crecency(cp), np->qh);
+  centries(cp)--;
+  cbytes(cp) -= np->size;
+}
+
+/* choose the next node other than keep to evict according to the
+ * policy
+ */
+static cnode_t *victim(hcache_t *cp, cnode_t *keep) {
+  cnode_t *np;
+
+  for(;;) {
+    np = (cnode_t*)qget(crecency(cp));	/* oldest entry */
+    if(np == NULL)
+      return NULL;
+    /* the link was just freed, so this put cannot fail */
+    np->qh = qput_handle(crecency(cp), np);
+    if(np == keep)
+      continue;
+    if(cpolicy(cp) != CACHE_CLOCK || !np->referenced)
+      return np;
+    np->referenced = false;	/* second chance -- go round again */
+  }
+}
+
+static bool over_limit(hcache_t *cp) {
+  return (cmaxentries(cp) > 0 && centries(cp) > cmaxentries(cp)) ||
+    (cmaxbytes(cp) > 0 && cbytes(cp) > cmaxbytes(cp));
+}
+
+/* evict node np, releasing its element */
+static void evict_node(hcache_t *cp, cnode_t *np) {
+  drop_node(cp, np);
+  release_element(cp, np->elementp);
+  free(np);
+}
+/* END OF PRIVATE SECTION */
+
+
+
+/* PUBLIC SECTION */
+
+cache_t *copen(uint32_t hsize, int policy, uint64_t maxentries,
+	       uint64_t maxbytes, void (*evictfn)(void *ep)) {
+  hcache_t *cp;
+
+  if(policy != CACHE_LRU && policy != CACHE_CLOCK)
+    return NULL;
+  cp = malloc(sizeof(hcache_t));
+  if(cp == NULL)
+    return NULL;
+  ctable(cp) = hopen(hsize);
+  crecency(cp) = qopen();
+  if(ctable(cp) == NULL || crecency(cp) == NULL) {
+    if(ctable(cp) != NULL)
+      hclose(ctable(cp));
+    if(crecency(cp) != NULL)
+      qclose(crecency(cp));
+    free(cp);
+    return NULL;
+  }
+  hsetkeyfn(ctable(cp), node_key);
+  cpolicy(cp) = policy;
+  cmaxentries(cp) = maxentries;
+  cmaxbytes(cp) = maxbytes;
+  centries(cp) = 0;
+  cbytes(cp) = 0;
+  chits(cp) = 0;
+  cmisses(cp) = 0;
+  cevictfn(cp) = evictfn;
+  return (cache_t*)cp;
+}
+
+void cclose(cache_t *cp) {
+  cnode_t *np;
+
+  /* release the elements; the nodes are free'd with the table */
+  while((np = (cnode_t*)qget(crecency(cp))) != NULL)
+    release_element(cp, np->elementp);
+  qclose(crecency(cp));
+  hclose(ctable(cp));
+  free(cp);
+}
+
+/*
+ * cput -- adds or replaces an element, then evicts down to the limits
+ */
+int32_t cput(cache_t *cp, void *ep, const char *key, int32_t keylen,
+	     uint64_t size) {
+  char buf[KEYBUFSIZE], *ekey;
+  cnode_t *np;
+
+  if((ekey = encode_key(buf, key, keylen)) == NULL)
+    return -1;
+  np = (cnode_t*)hsearch(ctable(cp), is_key, ekey, ekeylen(keylen));
+  if(np != NULL) {		/* replace in place */
+    if(np->elementp != ep)	/* (putting it again just resizes it) */
+      release_element(cp, np->elementp);
+    cbytes(cp) = cbytes(cp) - np->size + size;
+    np->elementp = ep;
+    np->size = size;
+    qmove_to_back(crecency(cp), np->qh);
+    np->referenced = false;
+  }
+  else {
+    np = malloc(sizeof(cnode_t) + ekeylen(keylen));
+    if(np == NULL) {
+      release_key(buf, ekey);
+      return -1;
+    }
+    np->elementp = ep;
+    np->size = size;
+    np->referenced = false;
+    memcpy(np->ekey, ekey, ekeylen(keylen));
+    if((np->qh = qput_handle(crecency(cp), np)) == NULL) {
+      free(np);
+      release_key(buf, ekey);
+      return -1;
+    }
+    if(hput(ctable(cp), np, np->ekey, ekeylen(keylen)) != 0) {
+      qremove_handle(crecency(cp), np->qh);
+      free(np);
+      release_key(buf, ekey);
+      return -1;
+    }
+    centries(cp)++;
+    cbytes(cp) += size;
+  }
+  release_key(buf, ekey);
+  /* evict, but never the entry just put */
+  while(over_limit(cp) && centries(cp) > 1)
+    evict_node(cp, victim(cp, np));
+  return 0;
+}
+
+/*
+ * cget -- lookup; a hit moves the entry to the back of the recency
+ * list (LRU) or sets its reference bit (CLOCK)
+ */
+void *cget(cache_t *cp, const char *key, int32_t keylen) {
+  char buf[KEYBUFSIZE], *ekey;
+  cnode_t *np;
+
+  if((ekey = encode_key(buf, key, keylen)) == NULL)
+    return NULL;
+  np = (cnode_t*)hsearch(ctable(cp), is_key, ekey, ekeylen(keylen));
+  release_key(buf, ekey);
+  if(np == NULL) {
+    cmisses(cp)++;
+    return NULL;
+  }
+  chits(cp)++;
+  if(cpolicy(cp) == CACHE_CLOCK)
+    np->referenced = true;
+  else
+    qmove_to_back(crecency(cp), np->qh);
+  return np->elementp;
+}
+
+void *cremove(cache_t *cp, const char *key, int32_t keylen) {
+  char buf[KEYBUFSIZE], *ekey;
+  cnode_t *np;
+  void *ep;
+
+  if((ekey = encode_key(buf, key, keylen)) == NULL)
+    return NULL;
+  np = (cnode_t*)hsearch(ctable(cp), is_key, ekey, ekeylen(keylen));
+  release_key(buf, ekey);
+  if(np == NULL)
+    return NULL;
+  ep = np->elementp;
+  drop_node(cp, np);
+  free(np);
+  return ep;
+}
+
+int32_t cevict(cache_t *cp) {
+  cnode_t *np;
+
+  if((np = victim(cp, NULL)) == NULL)
+    return -1;
+  evict_node(cp, np);
+  return 0;
+}
+
+void cstats(cache_t *cp, uint64_t *entriesp, uint64_t *bytesp,
+	    uint64_t *hitsp, uint64_t *missesp) {
+  if(entriesp) *entriesp = centries(cp);
+  if(bytesp) *bytesp = cbytes(cp);
+  if(hitsp) *hitsp = chits(cp);
+  if(missesp) *missesp = cmisses(cp);
+}
+
+/* END OF PUBLIC SECTION */
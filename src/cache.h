@@ -0,0 +1,54 @@
+#pragma once
+/*
+ * cache.h -- A bounded cache of elements stored under arbitrary keys,
+ * built from the hash and queue modules. Every operation is O(1) plus
+ * the cost of a hash lookup.
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void cache_t;		/* representation of a cache hidden */
+
+/* eviction policies */
+#define CACHE_LRU 0		/* evict the least recently used entry */
+#define CACHE_CLOCK 1		/* second chance -- resists large scans */
+
+/* copen -- opens a cache with hsize hash buckets, holding at most
+ * maxentries entries and maxbytes bytes (0 means unlimited); evictfn
+ * is called on every element evicted, replaced, or still cached when
+ * the cache is closed -- if evictfn is NULL such elements are free'd
+ * returns NULL if unsuccessful, or if policy is not one of the above
+ */
+cache_t *copen(uint32_t hsize, int policy, uint64_t maxentries,
+	       uint64_t maxbytes, void (*evictfn)(void *ep));
+
+/* cclose -- closes a cache, releasing every element in it */
+void cclose(cache_t *cp);
+
+/* cput -- puts an element of size bytes into the cache under key,
+ * replacing any element already there (which is released unless it is
+ * ep itself), and evicts entries until the cache is within its limits
+ * returns 0 for success; non-zero otherwise
+ */
+int32_t cput(cache_t *cp, void *ep, const char *key, int32_t keylen,
+	     uint64_t size);
+
+/* cget -- returns the element under key, marking it as recently used,
+ * or NULL if it is not cached
+ */
+void *cget(cache_t *cp, const char *key, int32_t keylen);
+
+/* cremove -- removes and returns the element under key without
+ * calling evictfn, or NULL if it is not cached
+ */
+void *cremove(cache_t *cp, const char *key, int32_t keylen);
+
+/* cevict -- evicts one entry chosen by the cache's policy
+ * returns 0 if an entry was evicted; non-zero if the cache was empty
+ */
+int32_t cevict(cache_t *cp);
+
+/* cstats -- reports the number of entries, bytes, hits and misses */
+void cstats(cache_t *cp, uint64_t *entriesp, uint64_t *bytesp,
+	    uint64_t *hitsp, uint64_t *missesp);
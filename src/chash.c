@@ -0,0 +1,255 @@
+/*
+ * chash.c -- implements a compact hash table: a small open-addressed
+ * index of 32-bit slot numbers pointing into a dense array of entries
+ * kept in insertion order (as in CPython's dict).
+ *
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <chash.h>
+#include <hashfn.h>
+
+#define MIN_ENTRIES 8		/* smallest entry array allocated */
+#define PERTURB_SHIFT 5		/* probe sequence mixing (see lookup) */
+#define EMPTY 0xFFFFFFFFu	/* index slot never used */
+#define DUMMY 0xFFFFFFFEu	/* index slot of a removed entry */
+#define MAX_ENTRIES (1u << 30)	/* so the index size fits 32 bits */
+
+
+/* PRIVATE SECTION */
+
+/* an entry in the dense array */
+typedef struct {
+  void *elementp;		/* the entry itself */
+  uint32_t hash;		/* full hash of its key */
+  uint32_t live;		/* zero once removed */
+} centry_t;
+
+/* the hidden structure of a compact hash table */
+typedef struct {
+  uint32_t *index;		/* slot numbers into entries */
+  uint32_t mask;		/* index size - 1; size is a power of 2 */
+  centry_t *entries;		/* dense, insertion-ordered entries */
+  uint32_t capacity;		/* entries allocated */
+  uint32_t used;		/* entries filled, including removed */
+  uint32_t live;		/* entries not removed */
+  uint32_t seed;		/* per-table key for the hash function */
+} hchash_t;
+
+/* accessor macros */
+#define cindex(htp) (((hchash_t*)htp)->index)
+#define cmask(htp) (((hchash_t*)htp)->mask)
+#define centries(htp) (((hchash_t*)htp)->entries)
+#define ccapacity(htp) (((hchash_t*)htp)->capacity)
+#define cused(htp) (((hchash_t*)htp)->used)
+#define clive(htp) (((hchash_t*)htp)->live)
+#define cseed(htp) (((hchash_t*)htp)->seed)
+
+#define chashfn(htp,key,keylen) SuperFastHashSeeded(key, keylen, cseed(htp))
+
+/* the probe sequence visits every index slot; an insertion is only
+ * ever made into an EMPTY slot, so entries with equal keys are met in
+ * insertion order (as they would be in a hash.c queue)
+ */
+#define first_probe(htp,hash) ((hash) & cmask(htp))
+#define next_probe(htp,i,perturb) (((i)*5 + (perturb) + 1) & cmask(htp))
+
+/*
+ * hidden helper functions
+ */
+
+/* size of index needed to keep capacity entries at most 2/3 full;
+ * capacity is at most MAX_ENTRIES, so this cannot overflow
+ */
+static uint32_t index_size(uint32_t capacity) {
+  uint32_t size;
+
+  for(size=MIN_ENTRIES; size < capacity + capacity/2; size <<= 1)
+    ;
+  return size;
+}
+
+/* record entry slot in the first empty index slot on its probe path */
+static void insert_index(hchash_t *htp, uint32_t slot) {
+  uint32_t i, perturb;
+
+  perturb = centries(htp)[slot].hash;
+  for(i=first_probe(htp,perturb); cindex(htp)[i] != EMPTY;
+      perturb >>= PERTURB_SHIFT, i=next_probe(htp,i,perturb))
+    ;
+  cindex(htp)[i] = slot;
+}
+
+/* find the index slot of the first matching entry, or EMPTY */
+static uint32_t lookup(hchash_t *htp,
+		       bool (*searchfn)(void *elementp, const void *searchkeyp),
+		       const char *key, uint32_t hash) {
+  uint32_t i, perturb, slot;
+  centry_t *entp;
+
+  perturb = hash;
+  for(i=first_probe(htp,hash); (slot=cindex(htp)[i]) != EMPTY;
+      perturb >>= PERTURB_SHIFT, i=next_probe(htp,i,perturb)) {
+    if(slot == DUMMY)
+      continue;
+    entp = &centries(htp)[slot];
+    if(entp->hash == hash && (*searchfn)(entp->elementp, key))
+      return i;
+  }
+  return EMPTY;
+}
+
+/*
+ * resize -- squeeze removed entries out of the dense array, reallocate
+ * it to hold capacity entries and rebuild the index; entries keep
+ * their stored hash, so nothing is rehashed
+ */
+static int32_t resize(hchash_t *htp, uint32_t capacity) {
+  centry_t *entries;
+  uint32_t *index;
+  uint32_t i, j, isize;
+  int32_t rc;
+
+  isize = index_size(capacity);
+  index = malloc(sizeof(uint32_t)*isize);
+  if(index == NULL)
+    return -1;
+  rc = 0;
+  if(capacity != ccapacity(htp)) {
+    entries = realloc(centries(htp), sizeof(centry_t)*capacity);
+    if(entries != NULL) {
+      centries(htp) = entries;
+      ccapacity(htp) = capacity;
+    }
+    else			/* still compact and reindex below */
+      rc = -1;
+  }
+  entries = centries(htp);
+  for(i=0, j=0; i<cused(htp); i++)	/* compact in order */
+    if(entries[i].live)
+      entries[j++] = entries[i];
+  cused(htp) = j;
+  free(cindex(htp));
+  cindex(htp) = index;
+  cmask(htp) = isize - 1;
+  memset(index, 0xFF, sizeof(uint32_t)*isize);	/* all EMPTY */
+  for(i=0; i<cused(htp); i++)
+    insert_index(htp, i);
+  return rc;
+}
+/* END OF PRIVATE SECTION */
+
+
+
+/* PUBLIC SECTION */
+
+chashtable_t *chopen(uint32_t hsize) {
+  hchash_t *htp;
+  uint64_t seed[2];
+
+  if(hsize < MIN_ENTRIES)
+    hsize = MIN_ENTRIES;
+  if(hsize > MAX_ENTRIES)
+    return NULL;
+  htp = malloc(sizeof(hchash_t));
+  if(htp == NULL)
+    return NULL;
+  RandomSeed(seed);
+  cseed(htp) = (uint32_t)seed[0];
+  centries(htp) = malloc(sizeof(centry_t)*hsize);
+  ccapacity(htp) = hsize;
+  cused(htp) = 0;
+  clive(htp) = 0;
+  cindex(htp) = NULL;
+  if(centries(htp) == NULL || resize(htp, hsize) != 0) {
+    free(centries(htp));
+    free(htp);
+    return NULL;
+  }
+  return (chashtable_t*)htp;
+}
+
+void chclose(chashtable_t *htp) {
+  centry_t *entp, *endp;
+
+  for(entp=centries(htp), endp=entp+cused(htp); entp<endp; entp++)
+    if(entp->live && entp->elementp != NULL)
+      free(entp->elementp);		  /* free each entry */
+  free(centries(htp));
+  free(cindex(htp));
+  free(htp);
+}
+
+/*
+ * chput -- appends an entry to the dense array, growing (or just
+ * compacting, if enough entries have been removed) when it is full
+ */
+int32_t chput(chashtable_t *htp, void *ep, const char *key, int keylen) {
+  centry_t *entp;
+  uint32_t capacity;
+
+  if(cused(htp) == ccapacity(htp)) {
+    capacity = ccapacity(htp);
+    if(clive(htp) >= capacity/2) {	/* mostly live -- grow */
+      if(capacity > MAX_ENTRIES/2)	/* index would overflow */
+	return -1;
+      capacity *= 2;
+    }
+    if(resize(htp, capacity) != 0)
+      return -1;
+  }
+  entp = &centries(htp)[cused(htp)];
+  entp->elementp = ep;
+  entp->hash = chashfn(htp, key, keylen);
+  entp->live = 1;
+  insert_index(htp, cused(htp));
+  cused(htp)++;
+  clive(htp)++;
+  return 0;
+}
+
+/*
+ * chapply -- a linear scan of the dense array
+ */
+void chapply(chashtable_t *htp, void (*fn)(void *ep)) {
+  centry_t *entp, *endp;
+
+  for(entp=centries(htp), endp=entp+cused(htp); entp<endp; entp++)
+    if(entp->live)
+      (*fn)(entp->elementp);
+}
+
+void* chsearch(chashtable_t *htp,
+	       bool (*searchfn)(void *elementp, const void *searchkeyp),
+	       const char *key, int32_t keylen) {
+  uint32_t i;
+
+  i = lookup(htp, searchfn, key, chashfn(htp, key, keylen));
+  if(i == EMPTY)
+    return NULL;
+  return centries(htp)[cindex(htp)[i]].elementp;
+}
+
+/*
+ * chremove -- the entry stays in the dense array, marked dead, until
+ * the next resize squeezes it out
+ */
+void* chremove(chashtable_t *htp,
+	       bool (*searchfn)(void* elementp, const void* searchkeyp),
+	       const char *key, int32_t keylen) {
+  centry_t *entp;
+  uint32_t i;
+
+  i = lookup(htp, searchfn, key, chashfn(htp, key, keylen));
+  if(i == EMPTY)
+    return NULL;
+  entp = &centries(htp)[cindex(htp)[i]];
+  cindex(htp)[i] = DUMMY;
+  entp->live = 0;
+  clive(htp)--;
+  return entp->elementp;
+}
+
+/* END OF PUBLIC SECTION */
@@ -0,0 +1,50 @@
+#pragma once
+/*
+ * chash.h -- A compact, insertion-ordered hash table allowing
+ * arbitrary key structures. It offers the same operations as hash.h,
+ * but entries live in a dense array, so iteration costs time
+ * proportional to the number of entries rather than the table size.
+ * Each table hashes with its own random seed, which blunts keys
+ * chosen in advance to collide but does not stop them (see hopen in
+ * hash.h).
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void chashtable_t;	/* representation of a table hidden */
+
+/* chopen -- opens a compact hash table with room for hsize entries
+ * before its first resize; a table holds at most 2^30 entries
+ * returns NULL if unsuccessful
+ */
+chashtable_t *chopen(uint32_t hsize);
+
+/* chclose -- closes a compact hash table, freeing every entry */
+void chclose(chashtable_t *htp);
+
+/* chput -- puts an entry into the table under designated key
+ * returns 0 for success; non-zero otherwise
+ */
+int32_t chput(chashtable_t *htp, void *ep, const char *key, int keylen);
+
+/* chapply -- applies a function to every entry, in insertion order */
+void chapply(chashtable_t *htp, void (*fn)(void* ep));
+
+/* chsearch -- searchs for an entry under a designated key using a
+ * designated search fn -- returns a pointer to the entry or NULL if
+ * not found
+ */
+void *chsearch(chashtable_t *htp,
+	       bool (*searchfn)(void* elementp, const void* searchkeyp),
+	       const char *key,
+	       int32_t keylen);
+
+/* chremove -- removes and returns an entry under a designated key
+ * using a designated search fn -- returns a pointer to the entry or
+ * NULL if not found
+ */
+void *chremove(chashtable_t *htp,
+	       bool (*searchfn)(void* elementp, const void* searchkeyp),
+	       const char *key,
+	       int32_t keylen);
@@ -2,131 +2,897 @@
  * hash.c -- implements a generic hash table as an indexed set of queues.
  *
  */
+#define _DEFAULT_SOURCE		/* for mmap flags and madvise */
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <queue.h>
 #include <hash.h>
+#include <hashfn.h>
+#include <trace.h>
+
+#define HTHREADS 4		/* most workers used by bulk operations */
+#define HBUILD_PERTHREAD 16384	/* fewest entries worth a worker */
+#define HBUILD_PARTS 256	/* bucket range partitions in hbuild */
+#define HCHAIN_MIN 32		/* chains this long are never suspect... */
+#define HCHAIN_FACTOR 8		/* ...nor those under 8x the average */
+#define HUGE_PAGE (2*1024*1024)	/* bucket arrays this big are mmap'd */
+#define BLOOM_BITS 12		/* filter bits per expected key */
+#define BLOOM_STALE 1024	/* fewest removals worth a filter rebuild */
+#define SCAN_BITS 48		/* scan cursor bits holding a bucket */
+#define HARDENED_BIT ((uint64_t)1 << 63) /* set in SipHash13 hashes */
+
+/* how a bucket array was allocated */
+#define REGION_MALLOC 0
+#define REGION_MMAP 1		/* anonymous, MADV_HUGEPAGE if wanted */
+#define REGION_HUGETLB 2	/* explicit huge pages */
 
 
 
 /* PRIVATE SECTION */
 
+/* one cache line of Bloom filter; a key sets one bit in each word */
+typedef struct {
+  uint64_t word[8];
+} bblock_t;
+
 /* the hidden structre of a hash table */
 typedef struct {
-  uint32_t table_size;		/* the size of the table */
+  uint64_t table_size;		/* the size of the table */
   void **table;			/* pointer to a table of void* */
+  uint32_t *chain_len;		/* number of entries in each queue */
+  int region;			/* how table and chain_len were allocated */
+  uint64_t entries;		/* number of entries in the table */
+  uint64_t seed[2];		/* per-table key for the hash function */
+  bool hardened;		/* hashing with SipHash13 */
+  const char *(*keyfn)(void *ep, int32_t *keylenp); /* or NULL */
+  bblock_t *bloom;		/* filter of keys present, or NULL */
+  uint64_t bloom_blocks;	/* size of the filter */
+  int bloom_region;		/* how the filter was allocated */
+  uint64_t bloom_keys;		/* number of keys it was sized for */
+  uint64_t bloom_removed;	/* removals since it was built */
+  uint16_t generation;		/* bumped by every rehash (see hscan) */
 } hhash_t;
 
 /* accessor macros */
 #define hsize(htp) (((hhash_t*)htp)->table_size)
 #define htable(htp) (((hhash_t*)htp)->table)
 #define hqueue(htp,qindex) (*(htable(htp)+qindex))
+#define hchain(htp) (((hhash_t*)htp)->chain_len)
+#define hregion(htp) (((hhash_t*)htp)->region)
+#define hentries(htp) (((hhash_t*)htp)->entries)
+#define hseed(htp) (((hhash_t*)htp)->seed)
+#define hhardened(htp) (((hhash_t*)htp)->hardened)
+#define hkeyfn(htp) (((hhash_t*)htp)->keyfn)
+#define hbloom(htp) (((hhash_t*)htp)->bloom)
+#define hbloomblocks(htp) (((hhash_t*)htp)->bloom_blocks)
+#define hbloomregion(htp) (((hhash_t*)htp)->bloom_region)
+#define hbloomkeys(htp) (((hhash_t*)htp)->bloom_keys)
+#define hbloomremoved(htp) (((hhash_t*)htp)->bloom_removed)
+#define hgeneration(htp) (((hhash_t*)htp)->generation)
 
-/* The following (rather complicated) code, between the dashed line
- * marks, has been taken from Paul Hsieh's website. It is under the
- * terms of the BSD license. It's a really good hash function used all
- * over the place nowadays, including Google Sparse Hash. 
-*/
-/*----------------------------------------------------------------*/
-#define get16bits(d) (*((const uint16_t *) (d)))
-
-static uint32_t SuperFastHash (const char *data, int len, uint32_t tablesize) {
-  uint32_t hash = len, tmp;
-  int rem;
-  
-  if (len <= 0 || data == NULL) return 0;
-  rem = len & 3;
-  len >>= 2;
-  /* Main loop */
-  for (;len > 0; len--) {
-    hash  += get16bits (data);
-    tmp    = (get16bits (data+2) << 11) ^ hash;
-    hash   = (hash << 16) ^ tmp;
-    data  += 2*sizeof (uint16_t);
-    hash  += hash >> 11;
-  }
-  /* Handle end cases */
-  switch (rem) {
-  case 3: hash += get16bits (data);
-    hash ^= hash << 16;
-    hash ^= data[sizeof (uint16_t)] << 18;
-    hash += hash >> 11;
-    break;
-  case 2: hash += get16bits (data);
-    hash ^= hash << 11;
-    hash += hash >> 17;
-    break;
-  case 1: hash += *data;
-    hash ^= hash << 10;
-    hash += hash >> 1;
-  }
-  /* Force "avalanching" of final 127 bits */
-  hash ^= hash << 3;
-  hash += hash >> 5;
-  hash ^= hash << 4;
-  hash += hash >> 17;
-  hash ^= hash << 25;
-  hash += hash >> 6;
-  return hash % tablesize;
-}
-/*-----------------------------------------------------------------*/
-
-#define hashfn(table,key,keylen)\
-	SuperFastHash(key, keylen, hsize(table))
-
-/*
- static uint32_t hashfn(hashtable_t *ctx, const char *key, int keylen) {
-  return SuperFastHash(key, keylen, hsize(ctx));
-}
-
-*/
-/* END OF PRIVATE SECTION */
+static bool huge_pages = true;	/* see hsethugepages */
+
+/*
+ * fullhash -- the table's hash of a key: the seeded SuperFastHash, or
+ * SipHash13 once the table is hardened (as tables from hopen, and of
+ * more than 2^32 queues, always are -- SuperFastHash only has 32
+ * bits). SipHash13 hashes have their top bit set, which no
+ * SuperFastHash has, so a hash kept by a caller shows which function
+ * made it (see hcurrent)
+ */
+static uint64_t fullhash(hashtable_t *htp, const char *key, int keylen) {
+  if(hhardened(htp))
+    return SipHash13(key, keylen, hseed(htp)[0], hseed(htp)[1]) | HARDENED_BIT;
+  return SuperFastHashSeeded(key, keylen, (uint32_t)hseed(htp)[0]);
+}
 
+/* the hash reduced to a queue index */
+#define hindex(htp,h) ((h) % hsize(htp))
+#define hashfn(htp,key,keylen) hindex(htp, fullhash(htp, key, keylen))
 
+/*
+ * The queue pointers and chain lengths of a table share one region.
+ * Random access to a region of tens of millions of buckets is
+ * dominated by TLB misses, so large regions are mmap'd onto huge
+ * pages: explicit ones if the system has them reserved, otherwise
+ * transparent ones requested with MADV_HUGEPAGE. mmap'd memory is
+ * zero, as calloc'd memory is.
+ */
+#define region_bytes(hsize) ((size_t)(hsize)*(sizeof(void*)+sizeof(uint32_t)))
+#define huge_round(bytes) (((bytes)+HUGE_PAGE-1)/HUGE_PAGE*HUGE_PAGE)
 
-/* PUBLIC SECTION */
+static void *alloc_region(size_t bytes, int *regionp) {
+  void *p;
+
+  if(bytes >= HUGE_PAGE) {
+#ifdef MAP_HUGETLB
+    if(huge_pages) {
+      p = mmap(NULL, huge_round(bytes), PROT_READ|PROT_WRITE,
+	       MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+      if(p != MAP_FAILED) {
+	*regionp = REGION_HUGETLB;
+	return p;
+      }
+    }
+#endif
+    p = mmap(NULL, bytes, PROT_READ|PROT_WRITE,
+	     MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(p != MAP_FAILED) {
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+      madvise(p, bytes, huge_pages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+#endif
+      *regionp = REGION_MMAP;
+      return p;
+    }
+  }
+  *regionp = REGION_MALLOC;
+  return calloc(bytes, 1);
+}
+
+static void free_region(void *p, size_t bytes, int region) {
+  if(region == REGION_HUGETLB)
+    munmap(p, huge_round(bytes));
+  else if(region == REGION_MMAP)
+    munmap(p, bytes);
+  else
+    free(p);
+}
+
+/* allocate the region of queue pointers and chain lengths for size
+ * buckets */
+static int32_t alloc_buckets(uint64_t size, void ***tablep,
+			     uint32_t **chainp, int *regionp) {
+  void **tp;
+
+  tp = alloc_region(region_bytes(size), regionp);
+  if(tp == NULL)
+    return -1;
+  *tablep = tp;
+  *chainp = (uint32_t*)(tp + size);
+  return 0;
+}
+
+static void free_buckets(hhash_t *htp) {
+  free_region(htable(htp), region_bytes(hsize(htp)), hregion(htp));
+}
+
+/*
+ * The optional Bloom filter is blocked: a key's bits all lie in one
+ * cache line, chosen from the high half of its hash (mixed, since
+ * SuperFastHash gives only 32 bits), with one bit in each of the
+ * line's 8 words chosen by multiplying the low half by a fixed odd
+ * salt. A miss thus costs one cache line read, and the 8 word tests
+ * are independent of each other.
+ */
+static const uint32_t bloom_salt[8] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+static uint32_t mix32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x85ebca6bU;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35U;
+  x ^= x >> 16;
+  return x;
+}
+
+static bblock_t *bloom_block(hashtable_t *htp, uint64_t h) {
+  uint32_t x;
+
+  x = mix32((uint32_t)h) ^ (uint32_t)(h >> 32);
+  return &hbloom(htp)[((uint64_t)x * hbloomblocks(htp)) >> 32];
+}
+
+static void bloom_add(hashtable_t *htp, uint64_t h) {
+  bblock_t *bp;
+  int i;
+
+  bp = bloom_block(htp, h);
+  for(i=0; i<8; i++)
+    bp->word[i] |= (uint64_t)1 << (((uint32_t)h * bloom_salt[i]) >> 26);
+}
 
-hashtable_t *hopen(uint32_t hsize) {
+static bool bloom_test(hashtable_t *htp, uint64_t h) {
+  bblock_t *bp;
+  uint64_t miss;
+  int i;
+
+  bp = bloom_block(htp, h);
+  for(miss=0, i=0; i<8; i++)
+    miss |= ~bp->word[i] &
+      ((uint64_t)1 << (((uint32_t)h * bloom_salt[i]) >> 26));
+  return miss == 0;
+}
+
+static void drop_bloom(hashtable_t *htp) {
+  if(hbloom(htp) != NULL)
+    free_region(hbloom(htp), sizeof(bblock_t)*hbloomblocks(htp),
+		hbloomregion(htp));
+  hbloom(htp) = NULL;
+}
+
+/*
+ * open_bloom -- replace the filter with one sized for nkeys keys and
+ * add every key in the table, found through the key function; each
+ * queue is walked by rotating it once with qtransfer
+ */
+static int32_t open_bloom(hashtable_t *htp, uint64_t nkeys) {
+  bblock_t *bloom;
+  uint64_t blocks, i;
+  uint32_t k;
+  int region;
+  const char *key;
+  int32_t keylen;
+
+  if(hentries(htp) > 0 && hkeyfn(htp) == NULL)
+    return -1;
+  blocks = nkeys*BLOOM_BITS/(8*sizeof(bblock_t)) + 1;
+  if(blocks > UINT32_MAX)
+    blocks = UINT32_MAX;
+  bloom = alloc_region(sizeof(bblock_t)*blocks, &region);
+  if(bloom == NULL)
+    return -1;
+  drop_bloom(htp);
+  hbloom(htp) = bloom;
+  hbloomblocks(htp) = blocks;
+  hbloomregion(htp) = region;
+  hbloomkeys(htp) = nkeys;
+  hbloomremoved(htp) = 0;
+  for(i=0; hentries(htp) > 0 && i<hsize(htp); i++)
+    for(k=hchain(htp)[i]; k>0; k--) {
+      key = (*hkeyfn(htp))(qpeek(hqueue(htp, i)), &keylen);
+      bloom_add(htp, fullhash(htp, key, keylen));
+      qtransfer(hqueue(htp, i), hqueue(htp, i));
+    }
+  return 0;
+}
+
+/*
+ * A chain far longer than the average is the mark of keys chosen to
+ * collide; a table that knows how to find its keys (hsetkeyfn)
+ * responds by hardening its hash function
+ */
+static bool chain_too_long(hashtable_t *htp, uint64_t len) {
+  return !hhardened(htp) && len > HCHAIN_MIN &&
+    len > HCHAIN_FACTOR*(hentries(htp)/hsize(htp) + 1);
+}
+
+static void check_chain(hashtable_t *htp, uint64_t len) {
+  if(hkeyfn(htp) != NULL && chain_too_long(htp, len))
+    hharden(htp);
+}
+
+static hashtable_t *open_table(uint64_t hsize, uint64_t seed0,
+			       uint64_t seed1) {
   hhash_t *htp;
-  void **tp, **p, **endp;
+  void **p, **endp;
   
   htp = malloc(sizeof(hhash_t));	  /* the hash table */
-  tp = malloc(sizeof(void*)*hsize);       /* indexed set of queues */
+  if(htp == NULL)
+    return NULL;
   hsize(htp) = hsize;
-  htable(htp) = tp;
-  for(p=tp, endp=tp+hsize; p<endp; p++)
+  if(alloc_buckets(hsize, &htable(htp), &hchain(htp), &hregion(htp)) != 0) {
+    free(htp);
+    return NULL;
+  }
+  for(p=htable(htp), endp=p+hsize; p<endp; p++)
     *p=qopen();			/* each entry is a queue */
+  hentries(htp) = 0;
+  hseed(htp)[0] = seed0;
+  hseed(htp)[1] = seed1;
+  hhardened(htp) = (hsize > UINT32_MAX);
+  hkeyfn(htp) = NULL;
+  hbloom(htp) = NULL;
+  hgeneration(htp) = 0;
   return (hashtable_t*)htp;
 }
 
+/*
+ * hbuild works in three parallel phases, each worker handling its own
+ * slice of the input and then its own range of partitions:
+ *  1. hash every key, counting entries per partition (a contiguous
+ *     range of buckets)
+ *  2. scatter entry numbers into order[], grouped by partition; the
+ *     scatter is stable, so entries keep their input order
+ *  3. sort each partition by bucket and put its entries, so that each
+ *     bucket's links are allocated together and no two workers ever
+ *     touch the same queue
+ */
+typedef struct {
+  hhash_t *htp;
+  void **elems;
+  const char **keys;
+  const int32_t *keylens;
+  uint64_t *bucket;		/* bucket of each entry */
+  uint64_t *order;		/* entry numbers grouped by partition */
+  uint64_t *pstart;		/* start of each partition in order */
+  uint64_t lo, hi;		/* slice of entries (phases 1 and 2) */
+  uint32_t plo, phi;		/* range of partitions (phase 3) */
+  uint64_t counts[HBUILD_PARTS]; /* entries, then offsets, per part */
+  uint64_t added;		/* entries put (phase 3) */
+  uint64_t longest;		/* longest chain put to (phase 3) */
+  int32_t rc;
+} hworker_t;
+
+#define part_width(htp) ((hsize(htp)+HBUILD_PARTS-1)/HBUILD_PARTS)
+#define partition(htp,b) ((uint32_t)((b)/part_width(htp)))
+#define first_bucket(htp,p)\
+	((uint64_t)(p)*part_width(htp) < hsize(htp) ?\
+	 (uint64_t)(p)*part_width(htp) : hsize(htp))
+
+static void *hash_slice(void *arg) {
+  hworker_t *wp = (hworker_t*)arg;
+  uint64_t i, b;
+
+  memset(wp->counts, 0, sizeof(wp->counts));
+  for(i=wp->lo; i<wp->hi; i++) {
+    b = hashfn(wp->htp, wp->keys[i], wp->keylens[i]);
+    wp->bucket[i] = b;
+    wp->counts[partition(wp->htp,b)]++;
+  }
+  return NULL;
+}
+
+static void *scatter_slice(void *arg) {
+  hworker_t *wp = (hworker_t*)arg;
+  uint64_t i;
+
+  for(i=wp->lo; i<wp->hi; i++)
+    wp->order[wp->counts[partition(wp->htp,wp->bucket[i])]++] = i;
+  return NULL;
+}
+
+static void *put_partitions(void *arg) {
+  hworker_t *wp = (hworker_t*)arg;
+  uint64_t k, b, blo, nb, *cnt, n;
+  void **sorted;
+  uint32_t p;
+
+  wp->rc = 0;
+  wp->added = 0;
+  wp->longest = 0;
+  for(p=wp->plo; p<wp->phi; p++) {
+    n = wp->pstart[p+1] - wp->pstart[p];
+    if(n == 0)
+      continue;
+    /* counting sort of the partition's elements by bucket */
+    blo = first_bucket(wp->htp,p);
+    nb = first_bucket(wp->htp,p+1) - blo;
+    cnt = calloc(nb+1, sizeof(uint64_t));
+    sorted = malloc(sizeof(void*)*n);
+    if(cnt == NULL || sorted == NULL) {
+      free(cnt);
+      free(sorted);
+      wp->rc = -1;
+      return NULL;
+    }
+    for(k=wp->pstart[p]; k<wp->pstart[p+1]; k++)
+      cnt[wp->bucket[wp->order[k]] - blo + 1]++;
+    for(b=0; b<nb; b++)
+      cnt[b+1] += cnt[b];
+    for(k=wp->pstart[p]; k<wp->pstart[p+1]; k++)
+      sorted[cnt[wp->bucket[wp->order[k]] - blo]++] = wp->elems[wp->order[k]];
+    /* cnt[b] now ends bucket blo+b's run, which starts where the
+     * previous one ends; each run goes into its queue at once */
+    for(b=0, k=0; b<nb; k=cnt[b++]) {
+      n = cnt[b] - k;
+      if(n == 0)
+	continue;
+      if(qput_n(hqueue(wp->htp, blo+b), &sorted[k], n) != 0) {
+	wp->rc = -1;
+	continue;
+      }
+      wp->added += n;
+      hchain(wp->htp)[blo+b] += (uint32_t)n;
+      if(hchain(wp->htp)[blo+b] > wp->longest)
+	wp->longest = hchain(wp->htp)[blo+b];
+    }
+    free(cnt);
+    free(sorted);
+  }
+  return NULL;
+}
+
+/* run fn on each of the nw workers of wsize bytes at wv, each in its
+ * own thread where possible
+ */
+static void run_workers(void *(*fn)(void *arg), void *wv, size_t wsize,
+			int nw) {
+  pthread_t tids[HTHREADS];
+  bool started[HTHREADS];
+  char *wp = (char*)wv;
+  int w;
+
+  for(w=1; w<nw; w++)
+    started[w] = (pthread_create(&tids[w], NULL, fn, wp+w*wsize) == 0);
+  (*fn)(wp);			/* the caller is worker 0 */
+  for(w=1; w<nw; w++) {
+    if(started[w])
+      pthread_join(tids[w], NULL);
+    else
+      (*fn)(wp+w*wsize);	/* no thread -- do it here */
+  }
+}
+
+/* a worker splicing a range of buckets for hmerge_parallel */
+typedef struct {
+  hhash_t *dst, *src;
+  uint64_t lo, hi;		/* range of buckets */
+  uint64_t longest;		/* longest chain spliced onto */
+} hsplicer_t;
+
+static void *splice_buckets(void *arg) {
+  hsplicer_t *sp = (hsplicer_t*)arg;
+  uint64_t i;
+
+  sp->longest = 0;
+  for(i=sp->lo; i<sp->hi; i++) {
+    qconcat(hqueue(sp->dst, i), hqueue(sp->src, i));
+    hchain(sp->dst)[i] += hchain(sp->src)[i];
+    if(hchain(sp->dst)[i] > sp->longest)
+      sp->longest = hchain(sp->dst)[i];
+  }
+  return NULL;
+}
+
+/* true if entries hash to the same queue in both tables */
+static bool same_geometry(hashtable_t *htp1, hashtable_t *htp2) {
+  return hsize(htp1) == hsize(htp2) &&
+    hhardened(htp1) == hhardened(htp2) &&
+    hseed(htp1)[0] == hseed(htp2)[0] &&
+    hseed(htp1)[1] == hseed(htp2)[1];
+}
+
+/* after splicing src into dst, bring the filter of dst up to date */
+static void merge_bloom(hashtable_t *dst, hashtable_t *src) {
+  uint64_t i;
+  int j;
+
+  if(hbloom(src) != NULL && hbloomblocks(src) == hbloomblocks(dst)) {
+    for(i=0; i<hbloomblocks(dst); i++)
+      for(j=0; j<8; j++)
+	hbloom(dst)[i].word[j] |= hbloom(src)[i].word[j];
+    hbloomremoved(dst) += hbloomremoved(src);
+  }
+  else if(open_bloom(dst, hentries(dst) > hbloomkeys(dst) ?
+		     hentries(dst) : hbloomkeys(dst)) != 0)
+    drop_bloom(dst);		/* a stale filter would give wrong misses */
+}
+
+/* rehash every entry of src into dst, leaving src empty */
+static int32_t rehash_into(hashtable_t *dst, hashtable_t *src,
+			   const char *(*keyfn)(void *ep, int32_t *keylenp)) {
+  uint64_t i;
+  void *qp, *ep;
+  const char *key;
+  int32_t keylen;
+
+  for(i=0; i<hsize(src); i++) {
+    qp = hqueue(src, i);
+    for(; hchain(src)[i] > 0; hchain(src)[i]--, hentries(src)--) {
+      ep = qget(qp);
+      key = (*keyfn)(ep, &keylen);
+      if(hput(dst, ep, key, keylen) != 0) {
+	qput(qp, ep);		/* reuses the link just freed */
+	return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+ * rebucket -- rehash into a fresh set of size queues, hardened or not;
+ * the queues are all opened first, and entries are then moved with
+ * qtransfer, which cannot fail
+ */
+static int32_t rebucket(hashtable_t *htp, uint64_t size, bool hardened) {
+  void **tp;
+  uint32_t *lens, k;
+  uint64_t i, j;
+  int region;
+  bool rehashed;
+  const char *key;
+  int32_t keylen;
+
+  if(hentries(htp) > 0 && hkeyfn(htp) == NULL)
+    return -1;			/* no way to rehash */
+  if(alloc_buckets(size, &tp, &lens, &region) != 0)
+    return -1;
+  for(i=0; i<size; i++)
+    if((tp[i] = qopen()) == NULL)
+      break;
+  if(i < size) {
+    while(i > 0)
+      qclose(tp[--i]);
+    free_region(tp, region_bytes(size), region);
+    return -1;
+  }
+  rehashed = (hardened != hhardened(htp));
+  hhardened(htp) = hardened;
+  for(i=0; i<hsize(htp); i++) {
+    for(k=hchain(htp)[i]; k>0; k--) {
+      key = (*hkeyfn(htp))(qpeek(hqueue(htp, i)), &keylen);
+      j = fullhash(htp, key, keylen) % size;
+      qtransfer(tp[j], hqueue(htp, i));
+      lens[j]++;
+    }
+    qclose(hqueue(htp, i));	/* now empty */
+  }
+  free_buckets(htp);
+  hgeneration(htp)++;		/* scans in progress start again */
+  hsize(htp) = size;
+  htable(htp) = tp;
+  hchain(htp) = lens;
+  hregion(htp) = region;
+  if(rehashed && hbloom(htp) != NULL &&
+     open_bloom(htp, hbloomkeys(htp)) != 0)
+    drop_bloom(htp);		/* the old filter no longer applies */
+  return 0;
+}
+
+/* the operations on a key already hashed to h */
+static int32_t put_hashed(hashtable_t *htp, void *ep, uint64_t h) {
+  uint64_t index;
+  void *qp;
+  
+  index=hindex(htp, h);		/* get queue index */
+  qp=hqueue(htp, index);	/* find queue */
+  if(qput(qp, ep) != 0)		/* put in queue */
+    return -1;
+  hentries(htp)++;
+  hchain(htp)[index]++;
+  if(hbloom(htp) != NULL) {
+    bloom_add(htp, h);
+    if(hentries(htp) > 2*hbloomkeys(htp) && hkeyfn(htp) != NULL)
+      open_bloom(htp, 2*hentries(htp));	/* outgrown -- double it */
+  }
+  check_chain(htp, hchain(htp)[index]);
+  return 0;
+}
+
+static void *search_hashed(hashtable_t *htp,
+			   bool (*searchfn)(void* elementp,
+					    const void* searchkeyp),
+			   const char *key, uint64_t h) {
+  if(hbloom(htp) != NULL && !bloom_test(htp, h))
+    return NULL;		/* certainly absent */
+  return qsearch(hqueue(htp, hindex(htp, h)), searchfn, key);
+}
+
+static void *remove_hashed(hashtable_t *htp,
+			   bool (*searchfn)(void* elementp,
+					    const void* searchkeyp),
+			   const char *key, uint64_t h) {
+  uint64_t index;
+  void *qp,*ep;
+  
+  if(hbloom(htp) != NULL && !bloom_test(htp, h))
+    return NULL;		/* certainly absent */
+  index=hindex(htp, h);		/* get queue index */
+  qp=hqueue(htp, index);
+  ep=qremove(qp, searchfn, key);
+  if(ep != NULL) {
+    hchain(htp)[index]--;
+    hentries(htp)--;
+    /* removed keys still set bits; rebuild once they outnumber the
+     * keys present */
+    if(hbloom(htp) != NULL && ++hbloomremoved(htp) > BLOOM_STALE &&
+       hbloomremoved(htp) > hentries(htp) && hkeyfn(htp) != NULL)
+      open_bloom(htp, hbloomkeys(htp));
+  }
+  return ep;
+}
+/* END OF PRIVATE SECTION */
+
+
+
+/* PUBLIC SECTION */
+
+hashtable_t *hopen(uint64_t hsize) {
+  hashtable_t *htp;
+  uint64_t seed[2];
+
+  RandomSeed(seed);
+  htp = open_table(hsize, seed[0], seed[1]);
+  if(htp != NULL)
+    hhardened(htp) = true;	/* SipHash13 from the start */
+  return htp;
+}
+
+hashtable_t *hopen_seed(uint64_t hsize, uint64_t seed) {
+  return open_table(hsize, seed, seed ^ 0x9e3779b97f4a7c15ULL);
+}
+
+hashtable_t *hopen_like(hashtable_t *htp) {
+  hashtable_t *newp;
+
+  newp = open_table(hsize(htp), hseed(htp)[0], hseed(htp)[1]);
+  if(newp == NULL)
+    return NULL;
+  hhardened(newp) = hhardened(htp);
+  hkeyfn(newp) = hkeyfn(htp);
+  if(hbloom(htp) != NULL)
+    open_bloom(newp, hbloomkeys(htp));	/* same size, so merges OR */
+  return newp;
+}
+
+void hsethugepages(bool enable) {
+  huge_pages = enable;
+}
+
+int32_t hsetbloom(hashtable_t *htp, uint64_t nkeys) {
+  if(nkeys == 0) {
+    drop_bloom(htp);
+    return 0;
+  }
+  return open_bloom(htp, nkeys);
+}
+
+void hsetkeyfn(hashtable_t *htp,
+	       const char *(*keyfn)(void *ep, int32_t *keylenp)) {
+  hkeyfn(htp) = keyfn;
+}
+
+int32_t hharden(hashtable_t *htp) {
+  if(hhardened(htp))
+    return 0;
+  return rebucket(htp, hsize(htp), true);
+}
+
+/*
+ * hshrink -- fewer buckets mean fewer queue structures, each with its
+ * own free list; the Bloom filter is resized too if it is now more
+ * than twice the size the table needs
+ */
+int32_t hshrink(hashtable_t *htp, uint64_t size) {
+  uint64_t i;
+
+  for(i=0; i<hsize(htp); i++)
+    qtrim(hqueue(htp, i));
+  if(size == 0)
+    size = hentries(htp) > 0 ? hentries(htp) : 1;
+  if(size < hsize(htp) && rebucket(htp, size, hhardened(htp)) != 0)
+    return -1;
+  if(hbloom(htp) != NULL && hbloomkeys(htp) > 2*hentries(htp) &&
+     hkeyfn(htp) != NULL)
+    open_bloom(htp, hentries(htp));	/* (kept as it is on failure) */
+  return 0;
+}
+
+/*
+ * hmemusage -- walks every queue, so takes time proportional to the
+ * size of the table plus its entries
+ */
+void hmemusage(hashtable_t *htp, hmem_t *mp) {
+  qmem_t qm;
+  uint64_t i;
+
+  memset(&qm, 0, sizeof(qm));
+  for(i=0; i<hsize(htp); i++)
+    qmemusage(hqueue(htp, i), &qm);
+  mp->header = sizeof(hhash_t);
+  mp->buckets = region_bytes(hsize(htp));
+  mp->queues = qm.header;
+  mp->links = qm.links;
+  mp->freelinks = qm.freelinks;
+  mp->bloom = hbloom(htp) != NULL ? sizeof(bblock_t)*hbloomblocks(htp) : 0;
+}
+
 void hclose(hashtable_t *htp) {
   void **tp,**p,**endp;
   
   tp = htable(htp);
   for(p=tp, endp=tp+hsize(htp); p<endp; p++)
     qclose(*p);				  /* close each queue */
-  free(tp);                               /* free the index */
+  free_buckets(htp);                      /* free the index */
+  drop_bloom(htp);
   free(htp);                              /* free the hash table */
 }
 
+uint64_t hhash(hashtable_t *htp, const char *key, int32_t keylen) {
+  return fullhash(htp, key, keylen);
+}
+
+/*
+ * hcurrent -- a table's hash function only ever changes by hardening,
+ * which is for good, so the hash's top bit says if it is current
+ */
+bool hcurrent(hashtable_t *htp, uint64_t h) {
+  return ((h & HARDENED_BIT) != 0) == hhardened(htp);
+}
+
 /*
  * hput -- adds an value to a hash table under a specific key
  */
 int32_t hput(hashtable_t *htp, void *ep, const char *key, int keylen) {
-  uint32_t index;
-  void *qp;
-  
-  index=hashfn(htp, key, keylen);	   /* get queue index */
-  qp=hqueue(htp, index);						 /* find queue */
-  return qput(qp, ep);							 /* put in queue */
+  int32_t rc;
+  TRACE_BEGIN(TR_HPUT, t);
+
+  rc=put_hashed(htp, ep, fullhash(htp, key, keylen));
+  TRACE_END(TR_HPUT, t);
+  return rc;
+}
+
+int32_t hput_h(hashtable_t *htp, void *ep, uint64_t h) {
+  int32_t rc;
+  TRACE_BEGIN(TR_HPUT, t);
+
+  rc=hcurrent(htp, h) ? put_hashed(htp, ep, h) : -1;
+  TRACE_END(TR_HPUT, t);
+  return rc;
+}
+
+/*
+ * hput_if_absent -- one hash and one walk of the chain: qsearch leaves
+ * nothing to undo, and qput appends in O(1)
+ */
+void *hput_if_absent(hashtable_t *htp, void *ep,
+		     bool (*searchfn)(void* elementp, const void* searchkeyp),
+		     const char *key, int32_t keylen) {
+  uint64_t h;
+  void *found;
+
+  h=fullhash(htp, key, keylen);
+  found=search_hashed(htp, searchfn, key, h);
+  if(found != NULL)
+    return found;
+  if(put_hashed(htp, ep, h) != 0)
+    return NULL;
+  return ep;
+}
+
+void *hupsert(hashtable_t *htp,
+	      bool (*searchfn)(void* elementp, const void* searchkeyp),
+	      const char *key, int32_t keylen,
+	      void *(*makefn)(const char *key, int32_t keylen, void *arg),
+	      void (*updatefn)(void *ep, void *arg), void *arg) {
+  uint64_t h;
+  void *ep;
+
+  h=fullhash(htp, key, keylen);
+  ep=search_hashed(htp, searchfn, key, h);
+  if(ep != NULL) {
+    (*updatefn)(ep, arg);
+    return ep;
+  }
+  ep=(*makefn)(key, keylen, arg);
+  if(ep == NULL || put_hashed(htp, ep, h) != 0)
+    return NULL;
+  return ep;
+}
+
+/*
+ * hbuild -- bulk insertion by radix partitioning (see above); falls
+ * back on hput if there is no memory for the partitioning arrays
+ */
+int32_t hbuild(hashtable_t *htp, void *elems[], const char *keys[],
+	       const int32_t keylens[], uint64_t n) {
+  hworker_t wv[HTHREADS];
+  uint64_t *bucket, *order, pstart[HBUILD_PARTS+1];
+  uint64_t i, off;
+  uint32_t p;
+  int w, nw;
+  int32_t rc;
+
+  bucket = malloc(sizeof(uint64_t)*n);
+  order = malloc(sizeof(uint64_t)*n);
+  if(bucket == NULL || order == NULL) {
+    free(bucket);
+    free(order);
+    for(rc=0, i=0; i<n; i++)
+      if(hput(htp, elems[i], keys[i], keylens[i]) != 0)
+	rc = -1;
+    return rc;
+  }
+  if(n / HBUILD_PERTHREAD > HTHREADS)
+    nw = HTHREADS;
+  else
+    nw = (int)(n / HBUILD_PERTHREAD);
+  if(nw < 1)
+    nw = 1;
+  for(w=0; w<nw; w++) {
+    wv[w].htp = (hhash_t*)htp;
+    wv[w].elems = elems;
+    wv[w].keys = keys;
+    wv[w].keylens = keylens;
+    wv[w].bucket = bucket;
+    wv[w].order = order;
+    wv[w].pstart = pstart;
+    wv[w].lo = n/nw*w;
+    wv[w].hi = (w == nw-1) ? n : n/nw*(w+1);
+    wv[w].plo = HBUILD_PARTS*w/nw;
+    wv[w].phi = HBUILD_PARTS*(w+1)/nw;
+  }
+  run_workers(hash_slice, wv, sizeof(hworker_t), nw);
+  /* turn per-worker counts into scatter offsets */
+  for(off=0, p=0; p<HBUILD_PARTS; p++) {
+    pstart[p] = off;
+    for(w=0; w<nw; w++) {
+      i = wv[w].counts[p];
+      wv[w].counts[p] = off;
+      off += i;
+    }
+  }
+  pstart[HBUILD_PARTS] = off;
+  run_workers(scatter_slice, wv, sizeof(hworker_t), nw);
+  run_workers(put_partitions, wv, sizeof(hworker_t), nw);
+  for(rc=0, w=0; w<nw; w++) {
+    if(wv[w].rc != 0)
+      rc = -1;
+    hentries(htp) += wv[w].added;
+  }
+  if(hbloom(htp) != NULL) {
+    if(hentries(htp) > 2*hbloomkeys(htp) && hkeyfn(htp) != NULL)
+      open_bloom(htp, 2*hentries(htp));
+    else			/* (a failed put only adds a false positive) */
+      for(i=0; i<n; i++)
+	bloom_add(htp, fullhash(htp, keys[i], keylens[i]));
+  }
+  for(w=0; w<nw; w++)
+    check_chain(htp, wv[w].longest);
+  free(bucket);
+  free(order);
+  return rc;
+}
+
+/*
+ * hmerge -- splice bucket i of src onto bucket i of dst when entries
+ * hash to the same bucket in both tables (see hopen_like); otherwise
+ * rehash
+ */
+int32_t hmerge(hashtable_t *dst, hashtable_t *src,
+	       const char *(*keyfn)(void *ep, int32_t *keylenp)) {
+  return hmerge_parallel(dst, src, keyfn, 1);
+}
+
+int32_t hmerge_parallel(hashtable_t *dst, hashtable_t *src,
+			const char *(*keyfn)(void *ep, int32_t *keylenp),
+			int nthreads) {
+  hsplicer_t sv[HTHREADS];
+  int w;
+
+  if(!same_geometry(dst, src)) {
+    if(keyfn == NULL)
+      keyfn = hkeyfn(src);
+    if(keyfn == NULL || rehash_into(dst, src, keyfn) != 0)
+      return -1;
+    hclose(src);		/* now empty */
+    return 0;
+  }
+  if(nthreads < 1)
+    nthreads = 1;
+  if(nthreads > HTHREADS)
+    nthreads = HTHREADS;
+  for(w=0; w<nthreads; w++) {
+    sv[w].dst = (hhash_t*)dst;
+    sv[w].src = (hhash_t*)src;
+    sv[w].lo = hsize(src)/nthreads*w;
+    sv[w].hi = (w == nthreads-1) ? hsize(src) : hsize(src)/nthreads*(w+1);
+  }
+  run_workers(splice_buckets, sv, sizeof(hsplicer_t), nthreads);
+  hentries(dst) += hentries(src);
+  if(hbloom(dst) != NULL)
+    merge_bloom(dst, src);
+  for(w=0; w<nthreads; w++)
+    check_chain(dst, sv[w].longest);
+  drop_bloom(src);
+  free_buckets(src);		/* its queues were closed by qconcat */
+  free(src);
+  return 0;
 }
 
 /*
  * happly -- apply a function to every entry in the table
  */
 void happly(hashtable_t *htp, void (*fn)(void *ep)) {
-  uint32_t i,hsize;
+  uint64_t i,hsize;
   void *qp;
   
   hsize = hsize(htp);
@@ -137,38 +903,86 @@ void happly(hashtable_t *htp, void (*fn)(void *ep)) {
   }
 }
 
+/*
+ * hscan -- a cursor is the generation of the table in its top bits
+ * and the next bucket to visit in the low SCAN_BITS. Buckets only
+ * change when the table is rehashed, which bumps the generation, so
+ * a cursor from another generation restarts the scan from bucket 0;
+ * with buckets chosen by hash modulo size, there is no bucket of the
+ * new layout that a cursor could map onto. Each queue is walked by
+ * rotating it once with qtransfer, which leaves it as it was.
+ */
+uint64_t hscan(hashtable_t *htp, uint64_t cursor, uint64_t budget,
+	       void (*fn)(void *ep, void *ctx), void *ctx) {
+  uint64_t b, cost;
+  uint32_t k;
+  void *qp;
+
+  b = cursor & (((uint64_t)1 << SCAN_BITS) - 1);
+  if((cursor >> SCAN_BITS) != hgeneration(htp) || b >= hsize(htp))
+    b = 0;			/* rehashed since -- start again */
+  if(budget == 0)
+    budget = 1;
+  for(cost=0; b<hsize(htp) && cost<budget; b++) {
+    qp = hqueue(htp, b);
+    for(k=hchain(htp)[b]; k>0; k--) {
+      (*fn)(qpeek(qp), ctx);
+      qtransfer(qp, qp);
+    }
+    cost += 1 + hchain(htp)[b];
+  }
+  if(b == hsize(htp))
+    return 0;			/* done */
+  return ((uint64_t)hgeneration(htp) << SCAN_BITS) | b;
+}
+
 /* 
  * hsearch -- find an entry matching key. We don't need to include the
  *            keylen in the searchfn call because that function has
  *            knowledge of what a key actually is.
  */ 
 void* hsearch(hashtable_t *htp, 
-              bool (*searchfn)(void *elementp, const void *searchkeyp),
-              const char *key, int keylen) {
-  uint32_t index;
-  void *qp,*ep;
-  
-  index=hashfn(htp, key, keylen); /* get queue index */
-  qp=hqueue(htp, index);
-  ep=qsearch(qp, searchfn, key);
+	      bool (*searchfn)(void* elementp, const void* searchkeyp), 
+	      const char *key, 
+	      int32_t keylen) {
+  void *ep;
+  TRACE_BEGIN(TR_HSEARCH, t);
+
+  ep=search_hashed(htp, searchfn, key, fullhash(htp, key, keylen));
+  TRACE_END(TR_HSEARCH, t);
   return ep;
 }
 
+void *hsearch_h(hashtable_t *htp,
+		bool (*searchfn)(void* elementp, const void* searchkeyp),
+		const char *key, uint64_t h) {
+  void *ep;
+  TRACE_BEGIN(TR_HSEARCH, t);
+
+  ep=hcurrent(htp, h) ? search_hashed(htp, searchfn, key, h) : NULL;
+  TRACE_END(TR_HSEARCH, t);
+  return ep;
+}
 
-/* 
- * hremove -- find an entry matching key. We don't need to include the
- *            keylen in the searchfn call because that function has
- *            knowledge of what a key actually is.
- */ 
 void* hremove(hashtable_t *htp, 
               bool (*searchfn)(void* elementp, const void* searchkeyp),
               const char *key, int keylen) {
-  uint32_t index;
-  void *qp,*ep;
-  
-  index=hashfn(htp, key, keylen); /* get queue index */
-  qp=hqueue(htp, index);
-  ep=qremove(qp, searchfn, key);
+  void *ep;
+  TRACE_BEGIN(TR_HREMOVE, t);
+
+  ep=remove_hashed(htp, searchfn, key, fullhash(htp, key, keylen));
+  TRACE_END(TR_HREMOVE, t);
+  return ep;
+}
+
+void *hremove_h(hashtable_t *htp,
+		bool (*searchfn)(void* elementp, const void* searchkeyp),
+		const char *key, uint64_t h) {
+  void *ep;
+  TRACE_BEGIN(TR_HREMOVE, t);
+
+  ep=hcurrent(htp, h) ? remove_hashed(htp, searchfn, key, h) : NULL;
+  TRACE_END(TR_HREMOVE, t);
   return ep;
 }
 
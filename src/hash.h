@@ -9,8 +9,85 @@
 
 typedef void hashtable_t;	/* representation of a hashtable hidden */
 
-/* hopen -- opens a hash table with initial size hsize */
-hashtable_t *hopen(uint32_t hsize);
+/* hopen -- opens a hash table with initial size hsize, hashing with
+ * SipHash-1-3 under its own random key, so keys cannot be chosen to
+ * collide in it
+ */
+hashtable_t *hopen(uint64_t hsize);
+
+/* hopen_seed -- opens a hash table whose seed is fixed, for
+ * reproducible runs, hashing with the faster but weaker SuperFastHash
+ * from that seed (0 gives the unkeyed SuperFastHash of old). A seed
+ * only blunts keys chosen to collide; a table with a key function
+ * (hsetkeyfn) switches to SipHash-1-3 by itself once a chain grows
+ * suspiciously long, as rehashing needs every entry's key, and one
+ * without can be switched with hharden while it is still empty.
+ * Tables of more than 2^32 buckets always hash with SipHash-1-3
+ */
+hashtable_t *hopen_seed(uint64_t hsize, uint64_t seed);
+
+/* hopen_like -- opens an empty hash table with the same size, seed,
+ * hash function and key function as htp, so that hmerge between them
+ * can splice buckets
+ */
+hashtable_t *hopen_like(hashtable_t *htp);
+
+/* hsethugepages -- chooses whether the bucket arrays of tables opened
+ * (or rehashed) from now on are placed on huge pages where the system
+ * supports them; on by default
+ */
+void hsethugepages(bool enable);
+
+/* hsetbloom -- gives the table a Bloom filter sized for nkeys keys,
+ * letting most searches and removals of absent keys return after one
+ * cache line read; a table holding entries needs a key function
+ * (hsetkeyfn) to fill the filter, and with one the filter is also
+ * regrown and rebuilt as entries come and go. nkeys of 0 removes it
+ * returns 0 for success; non-zero otherwise
+ */
+int32_t hsetbloom(hashtable_t *htp, uint64_t nkeys);
+
+/* hsetkeyfn -- tells the table how to find the key of an element:
+ * keyfn returns the key and sets *keylenp to its length. A table
+ * from hopen_seed with a key function hardens itself (see hharden)
+ * as soon as one of its chains grows far longer than the average
+ */
+void hsetkeyfn(hashtable_t *htp,
+	       const char *(*keyfn)(void *ep, int32_t *keylenp));
+
+/* hharden -- switches a table from hopen_seed to the keyed
+ * SipHash-1-3 hash, which resists keys chosen to collide, rehashing
+ * any entries (tables from hopen start out hardened)
+ * returns 0 for success; non-zero otherwise -- a table holding entries
+ * but without a key function cannot be rehashed
+ */
+int32_t hharden(hashtable_t *htp);
+
+/* hshrink -- gives back memory after mass removal: frees the links
+ * each queue caches for reuse and, given a key function, rehashes
+ * into size buckets if that is fewer than now (0 means one per entry)
+ * and shrinks an oversized Bloom filter
+ * returns 0 for success; non-zero otherwise (the buckets are left
+ * as they were)
+ */
+int32_t hshrink(hashtable_t *htp, uint64_t size);
+
+/* bytes of memory held by a hash table, by category -- as requested
+ * from the allocator, not counting its own overhead
+ */
+typedef struct {
+  uint64_t header;		/* the table structure */
+  uint64_t buckets;		/* queue pointers and chain lengths */
+  uint64_t queues;		/* queue structures */
+  uint64_t links;		/* links holding entries */
+  uint64_t freelinks;		/* links cached for reuse */
+  uint64_t bloom;		/* the Bloom filter, if any */
+} hmem_t;
+
+/* hmemusage -- sets *mp to the memory held by the table (but not by
+ * its entries)
+ */
+void hmemusage(hashtable_t *htp, hmem_t *mp);
 
 /* hclose -- closes a hash table */
 void hclose(hashtable_t *htp);
@@ -20,9 +97,96 @@ void hclose(hashtable_t *htp);
  */
 int32_t hput(hashtable_t *htp, void *ep, const char *key, int keylen);
 
+/* hput_if_absent -- puts an entry under designated key unless the
+ * search fn finds one there already, hashing the key and walking its
+ * chain only once -- returns the entry found, or ep if it was put, or
+ * NULL if the put failed
+ */
+void *hput_if_absent(hashtable_t *htp, void *ep,
+		     bool (*searchfn)(void* elementp, const void* searchkeyp),
+		     const char *key, int32_t keylen);
+
+/* hupsert -- finds the entry under designated key and applies
+ * updatefn(ep,arg) to it, or, if there is none, puts the entry made
+ * by makefn(key,keylen,arg) -- one hash and one chain walk either way
+ * returns the entry updated or made; NULL if makefn or the put failed
+ */
+void *hupsert(hashtable_t *htp,
+	      bool (*searchfn)(void* elementp, const void* searchkeyp),
+	      const char *key, int32_t keylen,
+	      void *(*makefn)(const char *key, int32_t keylen, void *arg),
+	      void (*updatefn)(void *ep, void *arg), void *arg);
+
+/* hhash -- the hash of a key in this table, for the _h variants below
+ * (and any table opened with hopen_like it); a hash goes stale when
+ * the table is hardened -- by hharden, or by any hput in a table with
+ * a key function -- so callers keeping hashes should harden first
+ */
+uint64_t hhash(hashtable_t *htp, const char *key, int32_t keylen);
+
+/* hcurrent -- true if a hash from hhash is still valid for the table */
+bool hcurrent(hashtable_t *htp, uint64_t hash);
+
+/* hput_h, hsearch_h, hremove_h -- as hput, hsearch and hremove, but
+ * taking the key's hash from hhash instead of hashing it again; a
+ * stale hash is rejected -- hput_h fails, the others return NULL -- so
+ * the key must then be hashed again
+ */
+int32_t hput_h(hashtable_t *htp, void *ep, uint64_t hash);
+
+void *hsearch_h(hashtable_t *htp,
+		bool (*searchfn)(void* elementp, const void* searchkeyp),
+		const char *key, uint64_t hash);
+
+void *hremove_h(hashtable_t *htp,
+		bool (*searchfn)(void* elementp, const void* searchkeyp),
+		const char *key, uint64_t hash);
+
+/* hbuild -- puts n entries into a hash table in bulk: elems[i] under
+ * key keys[i] of length keylens[i]; the result is the same as n calls
+ * to hput in order, but keys are hashed and partitioned by bucket in
+ * parallel and each bucket's chain is then built in one go
+ * returns 0 for success; non-zero otherwise (some entries may be in)
+ */
+int32_t hbuild(hashtable_t *htp, void *elems[], const char *keys[],
+	       const int32_t keylens[], uint64_t n);
+
+/* hmerge -- moves every entry of src into dst and closes src
+ * when the tables hash alike (see hopen_like) each bucket is spliced
+ * across in O(1); otherwise entries are rehashed using keyfn (or the
+ * key function of src if keyfn is NULL), which returns the key of an
+ * element and sets *keylenp to its length
+ * returns 0 for success; non-zero otherwise -- if the tables differ
+ * and there is no key function nothing is moved, and if a put fails src is left
+ * open holding the entries not yet moved
+ */
+int32_t hmerge(hashtable_t *dst, hashtable_t *src,
+	       const char *(*keyfn)(void *ep, int32_t *keylenp));
+
+/* hmerge_parallel -- as hmerge, but splits the bucket range of
+ * tables that hash alike across up to nthreads threads
+ */
+int32_t hmerge_parallel(hashtable_t *dst, hashtable_t *src,
+			const char *(*keyfn)(void *ep, int32_t *keylenp),
+			int nthreads);
+
 /* happly -- applies a function to every entry in hash table */
 void happly(hashtable_t *htp, void (*fn)(void* ep));
 
+/* hscan -- applies fn(ep,ctx) to the entries of successive buckets,
+ * starting from cursor (0 to begin), until about budget buckets and
+ * entries have been visited (a bucket is never split, so a long chain
+ * may take more) -- returns the cursor to resume from, or 0 once the
+ * scan is done. The table may change between calls, but not from
+ * within fn: every entry present for the whole scan is visited at
+ * least once, and a rehash (hharden, hshrink) restarts the scan, so
+ * some entries may be visited again. A table hardens at most once, by
+ * itself or not, so only a caller calling hshrink again before each
+ * scan finishes can keep it from ever finishing
+ */
+uint64_t hscan(hashtable_t *htp, uint64_t cursor, uint64_t budget,
+	       void (*fn)(void *ep, void *ctx), void *ctx);
+
 /* hsearch -- searchs for an entry under a designated key using a
  * designated search fn -- returns a pointer to the entry or NULL if
  * not found
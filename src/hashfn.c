@@ -0,0 +1,134 @@
+/*
+ * hashfn.c -- hash functions shared by the hash table modules.
+ *
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+#include <hashfn.h>
+
+/* The following (rather complicated) code, between the dashed line
+ * marks, has been taken from Paul Hsieh's website. It is under the
+ * terms of the BSD license. It's a really good hash function used all
+ * over the place nowadays, including Google Sparse Hash. 
+*/
+/*----------------------------------------------------------------*/
+/* (keys may sit at any address, so the loads go through memcpy, which
+ * compiles to a plain load where unaligned ones are allowed)
+ */
+static inline uint16_t get16bits(const char *d) {
+  uint16_t v;
+
+  memcpy(&v, d, sizeof(v));
+  return v;
+}
+
+uint32_t SuperFastHashSeeded (const char *data, int len, uint32_t seed) {
+  uint32_t hash = len ^ seed, tmp;
+  int rem;
+  
+  if (len <= 0 || data == NULL) return 0;
+  rem = len & 3;
+  len >>= 2;
+  /* Main loop */
+  for (;len > 0; len--) {
+    hash  += get16bits (data);
+    tmp    = (get16bits (data+2) << 11) ^ hash;
+    hash   = (hash << 16) ^ tmp;
+    data  += 2*sizeof (uint16_t);
+    hash  += hash >> 11;
+  }
+  /* Handle end cases */
+  switch (rem) {
+  case 3: hash += get16bits (data);
+    hash ^= hash << 16;
+    hash ^= data[sizeof (uint16_t)] << 18;
+    hash += hash >> 11;
+    break;
+  case 2: hash += get16bits (data);
+    hash ^= hash << 11;
+    hash += hash >> 17;
+    break;
+  case 1: hash += *data;
+    hash ^= hash << 10;
+    hash += hash >> 1;
+  }
+  /* Force "avalanching" of final 127 bits */
+  hash ^= hash << 3;
+  hash += hash >> 5;
+  hash ^= hash << 4;
+  hash += hash >> 17;
+  hash ^= hash << 25;
+  hash += hash >> 6;
+  return hash;
+}
+/*-----------------------------------------------------------------*/
+
+uint32_t SuperFastHash(const char *data, int len) {
+  return SuperFastHashSeeded(data, len, 0);
+}
+
+/* SipHash-1-3 (Aumasson and Bernstein): one compression round per
+ * 8-byte word and three finalization rounds
+ */
+#define ROTL(x,b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND do {						\
+    v0 += v1; v1 = ROTL(v1,13); v1 ^= v0; v0 = ROTL(v0,32);	\
+    v2 += v3; v3 = ROTL(v3,16); v3 ^= v2;				\
+    v0 += v3; v3 = ROTL(v3,21); v3 ^= v0;				\
+    v2 += v1; v1 = ROTL(v1,17); v1 ^= v2; v2 = ROTL(v2,32);	\
+  } while(0)
+
+/* little-endian load of n (<= 8) bytes */
+static uint64_t load64(const unsigned char *p, int n) {
+  uint64_t v = 0;
+  int i;
+
+  for(i=0; i<n; i++)
+    v |= (uint64_t)p[i] << (8*i);
+  return v;
+}
+
+uint64_t SipHash13(const char *data, int len, uint64_t k0, uint64_t k1) {
+  const unsigned char *p = (const unsigned char*)data;
+  uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+  uint64_t m;
+  int left;
+
+  if(len < 0 || data == NULL)
+    len = 0;
+  for(left=len; left>=8; left-=8, p+=8) {
+    m = load64(p, 8);
+    v3 ^= m;
+    SIPROUND;
+    v0 ^= m;
+  }
+  m = ((uint64_t)len << 56) | load64(p, left);
+  v3 ^= m;
+  SIPROUND;
+  v0 ^= m;
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* from the kernel's random bits (getrandom reads no file and, once the
+ * pool is initialised, never blocks), or failing that from the clock
+ */
+void RandomSeed(uint64_t seed[2]) {
+  static uint64_t count;	/* differs between calls */
+
+  if(getrandom(seed, 2*sizeof(uint64_t), 0) == (ssize_t)(2*sizeof(uint64_t)))
+    return;
+  seed[0] = (uint64_t)time(NULL) ^ ((uint64_t)(uintptr_t)seed << 16);
+  seed[0] ^= ++count;
+  seed[1] = SipHash13((const char*)seed, sizeof(uint64_t),
+		      (uint64_t)clock(), count);
+}
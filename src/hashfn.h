@@ -0,0 +1,26 @@
+#pragma once
+/*
+ * hashfn.h -- hash functions shared by the hash table modules; each
+ * returns a full hash value which callers reduce to a table index.
+ *
+ */
+#include <stdint.h>
+
+/* SuperFastHash -- Paul Hsieh's hash of len bytes at data */
+uint32_t SuperFastHash(const char *data, int len);
+
+/* SuperFastHashSeeded -- SuperFastHash started from a seed; a seed of
+ * 0 gives SuperFastHash. Fast, but not a defence against keys chosen
+ * to collide (see SipHash13)
+ */
+uint32_t SuperFastHashSeeded(const char *data, int len, uint32_t seed);
+
+/* SipHash13 -- SipHash-1-3 of len bytes at data under the 128-bit key
+ * (k0,k1): a keyed hash whose collisions cannot be found without the key
+ */
+uint64_t SipHash13(const char *data, int len, uint64_t k0, uint64_t k1);
+
+/* RandomSeed -- fills seed with random bits, for seeding the hashes
+ * of a table so that keys cannot be chosen in advance to collide
+ */
+void RandomSeed(uint64_t seed[2]);
@@ -0,0 +1,201 @@
+/*
+ * lhash.c -- implements a lean chained hash table: buckets of 32-bit
+ * link indices heading singly-linked chains through a pool of links.
+ *
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <lhash.h>
+#include <hashfn.h>
+
+#define NIL 0			/* the null link index; pool[0] is unused */
+#define MIN_POOL 16		/* smallest link pool allocated */
+#define MAX_POOL UINT32_MAX	/* indices 1..MAX_POOL-1 */
+
+
+/* PRIVATE SECTION */
+
+/*
+ * Links are allocated from one growing array, so an index stays valid
+ * when the array moves; removed links are kept on a free list through
+ * their next fields. Each link caches its key's full hash, in what
+ * would otherwise be padding, so most mismatches in a chain are found
+ * without calling the search function. A link cannot drop below 16
+ * bytes while entries are pointers: the pointer and a 4-byte index
+ * pad to 16 anyway.
+ */
+typedef struct {
+  void *elementp;		/* the entry itself */
+  uint32_t next;		/* next link in the chain, or NIL */
+  uint32_t hash;		/* full hash of its key */
+} llink_t;
+
+/* the hidden structure of a lean hash table */
+typedef struct {
+  uint32_t *buckets;		/* chain heads */
+  uint32_t hsize;
+  llink_t *pool;		/* every link */
+  uint32_t capacity;		/* links allocated */
+  uint32_t used;		/* links ever handed out, pool[0] included */
+  uint32_t free;		/* head of the free links */
+  uint32_t seed;		/* per-table key for the hash function */
+} hlhash_t;
+
+/* accessor macros */
+#define lbuckets(htp) (((hlhash_t*)htp)->buckets)
+#define lhsize(htp) (((hlhash_t*)htp)->hsize)
+#define lpool(htp) (((hlhash_t*)htp)->pool)
+#define lcapacity(htp) (((hlhash_t*)htp)->capacity)
+#define lused(htp) (((hlhash_t*)htp)->used)
+#define lfree(htp) (((hlhash_t*)htp)->free)
+#define lseed(htp) (((hlhash_t*)htp)->seed)
+
+#define llink(htp,i) (&lpool(htp)[i])
+#define lhashfn(htp,key,keylen) SuperFastHashSeeded(key, keylen, lseed(htp))
+
+/*
+ * hidden helper functions
+ */
+
+/* take a link from the free list, or the end of the pool, growing it */
+static uint32_t alloc_link(hlhash_t *htp) {
+  llink_t *pool;
+  uint64_t capacity;
+  uint32_t i;
+
+  if((i = lfree(htp)) != NIL) {
+    lfree(htp) = llink(htp, i)->next;
+    return i;
+  }
+  if(lused(htp) == lcapacity(htp)) {
+    if(lcapacity(htp) == MAX_POOL)
+      return NIL;
+    capacity = (uint64_t)lcapacity(htp)*2;
+    if(capacity > MAX_POOL)
+      capacity = MAX_POOL;
+    pool = realloc(lpool(htp), sizeof(llink_t)*capacity);
+    if(pool == NULL)
+      return NIL;
+    lpool(htp) = pool;
+    lcapacity(htp) = (uint32_t)capacity;
+  }
+  return lused(htp)++;
+}
+
+static void free_link(hlhash_t *htp, uint32_t i) {
+  llink(htp, i)->next = lfree(htp);
+  lfree(htp) = i;
+}
+
+/* the index (bucket or next field) pointing to the first matching
+ * link, or to NIL at the end of its chain
+ */
+static uint32_t *find(hlhash_t *htp,
+		      bool (*searchfn)(void *elementp, const void *searchkeyp),
+		      const char *key, uint32_t hash) {
+  uint32_t *ip;
+  llink_t *lp;
+
+  for(ip=&lbuckets(htp)[hash % lhsize(htp)]; *ip != NIL; ip=&lp->next) {
+    lp = llink(htp, *ip);
+    if(lp->hash == hash && (*searchfn)(lp->elementp, key))
+      break;
+  }
+  return ip;
+}
+/* END OF PRIVATE SECTION */
+
+
+
+/* PUBLIC SECTION */
+
+lhashtable_t *lhopen(uint32_t hsize) {
+  hlhash_t *htp;
+  uint64_t seed[2];
+
+  if(hsize == 0)
+    hsize = 1;
+  htp = malloc(sizeof(hlhash_t));
+  if(htp == NULL)
+    return NULL;
+  lbuckets(htp) = calloc(hsize, sizeof(uint32_t));	/* all NIL */
+  lpool(htp) = malloc(sizeof(llink_t)*MIN_POOL);
+  if(lbuckets(htp) == NULL || lpool(htp) == NULL) {
+    free(lbuckets(htp));
+    free(lpool(htp));
+    free(htp);
+    return NULL;
+  }
+  lhsize(htp) = hsize;
+  lcapacity(htp) = MIN_POOL;
+  lused(htp) = 1;		/* pool[0] stands for NIL */
+  lfree(htp) = NIL;
+  RandomSeed(seed);
+  lseed(htp) = (uint32_t)seed[0];
+  return (lhashtable_t*)htp;
+}
+
+void lhclose(lhashtable_t *htp) {
+  lhapply(htp, free);		/* free each entry */
+  free(lbuckets(htp));
+  free(lpool(htp));
+  free(htp);
+}
+
+/*
+ * lhput -- pushes a link on the front of its chain, O(1)
+ */
+int32_t lhput(lhashtable_t *htp, void *ep, const char *key, int keylen) {
+  uint32_t hash, i, *headp;
+  llink_t *lp;
+
+  hash = lhashfn(htp, key, keylen);
+  if((i = alloc_link(htp)) == NIL)
+    return -1;
+  headp = &lbuckets(htp)[hash % lhsize(htp)];
+  lp = llink(htp, i);
+  lp->elementp = ep;
+  lp->hash = hash;
+  lp->next = *headp;
+  *headp = i;
+  return 0;
+}
+
+/*
+ * lhapply -- walks each chain, as hash.c walks each queue
+ */
+void lhapply(lhashtable_t *htp, void (*fn)(void *ep)) {
+  uint32_t b, i;
+
+  for(b=0; b<lhsize(htp); b++)
+    for(i=lbuckets(htp)[b]; i != NIL; i=llink(htp, i)->next)
+      (*fn)(llink(htp, i)->elementp);
+}
+
+void* lhsearch(lhashtable_t *htp,
+	       bool (*searchfn)(void *elementp, const void *searchkeyp),
+	       const char *key, int32_t keylen) {
+  uint32_t i;
+
+  i = *find(htp, searchfn, key, lhashfn(htp, key, keylen));
+  return i == NIL ? NULL : llink(htp, i)->elementp;
+}
+
+void* lhremove(lhashtable_t *htp,
+	       bool (*searchfn)(void* elementp, const void* searchkeyp),
+	       const char *key, int32_t keylen) {
+  uint32_t *ip, i;
+  void *ep;
+
+  ip = find(htp, searchfn, key, lhashfn(htp, key, keylen));
+  if((i = *ip) == NIL)
+    return NULL;
+  ep = llink(htp, i)->elementp;
+  *ip = llink(htp, i)->next;	/* unlink, then recycle */
+  free_link(htp, i);
+  return ep;
+}
+
+/* END OF PUBLIC SECTION */
@@ -0,0 +1,51 @@
+#pragma once
+/*
+ * lhash.h -- A lean chained hash table allowing arbitrary key
+ * structures. It offers the same operations as hash.h, but its chains
+ * are singly linked through 32-bit indices into a pool of links, so
+ * an entry costs 16 bytes (its element pointer, a link and its hash)
+ * and a bucket 4, against 24 and 32 for the queues of hash.c. That is
+ * twice the 8 bytes an entry would take if elements were 32-bit
+ * indices too; as they are pointers, 16 is the floor.
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void lhashtable_t;	/* representation of a table hidden */
+
+/* lhopen -- opens a lean hash table with hsize buckets; it holds up
+ * to 2^32 - 2 entries. Its hash is seeded at random, which blunts
+ * keys chosen to collide but does not stop them (see hopen in hash.h)
+ */
+lhashtable_t *lhopen(uint32_t hsize);
+
+/* lhclose -- closes a lean hash table, freeing every entry */
+void lhclose(lhashtable_t *htp);
+
+/* lhput -- puts an entry into the table under designated key; of
+ * entries with equal keys, the one put last is found first
+ * returns 0 for success; non-zero otherwise
+ */
+int32_t lhput(lhashtable_t *htp, void *ep, const char *key, int keylen);
+
+/* lhapply -- applies a function to every entry in the table */
+void lhapply(lhashtable_t *htp, void (*fn)(void* ep));
+
+/* lhsearch -- searchs for an entry under a designated key using a
+ * designated search fn -- returns a pointer to the entry or NULL if
+ * not found
+ */
+void *lhsearch(lhashtable_t *htp,
+	       bool (*searchfn)(void* elementp, const void* searchkeyp),
+	       const char *key,
+	       int32_t keylen);
+
+/* lhremove -- removes and returns an entry under a designated key
+ * using a designated search fn -- returns a pointer to the entry or
+ * NULL if not found
+ */
+void *lhremove(lhashtable_t *htp,
+	       bool (*searchfn)(void* elementp, const void* searchkeyp),
+	       const char *key,
+	       int32_t keylen);
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <queue.h>
+#include <trace.h>
 
 /* general definitions */
 #define DEFAULT_MAX_FREE 50	/* at most 50 free links allowed */
@@ -71,6 +72,66 @@ static hlink_t* get_link(hqueue_t *qp) {
   }
   return lp;                               
 }
+
+/* unlink p from the queue, leaving the link itself untouched */
+static void cut_link(hqueue_t *qp,hlink_t *p) {
+  if(prev(p))			       /* something before p? */
+    next(prev(p)) = next(p);           /* prev points past p */
+  else				       /* p is front of q */
+    front(qp) = next(p);               /* set new front */
+  if(next(p))			       /* something after p? */
+    prev(next(p)) = prev(p);           /* next points past p */
+  else				       /* p is back of q */
+    back(qp) = prev(p);                /* set new back */
+}
+
+/* link p in at the back of the queue */
+static void append_link(hqueue_t *qp,hlink_t *p) {
+  hlink_t *bp;
+
+  next(p)=NULL;
+  bp=back(qp);
+  prev(p)=bp;                          /* previous is old back */
+  if(bp)			       /* list is not empty */
+    next(bp)=p;                        /* change last entry */
+  else
+    front(qp) = p;                     /* front of the queue */
+  back(qp) = p;			       /* new is now queue back */
+}
+
+/* 
+ * merge_links -- stable merge of two sorted chains linked through
+ * next only; on ties links from a come first
+ */
+static hlink_t* merge_links(hlink_t *a, hlink_t *b,
+			    int (*cmpfn)(void *e1p, void *e2p)) {
+  hlink_t *head, **tailp;
+
+  tailp=&head;
+  while(a!=NULL && b!=NULL) {
+    if((*cmpfn)(element(b),element(a)) < 0) {
+      *tailp=b;
+      b=next(b);
+    }
+    else {
+      *tailp=a;
+      a=next(a);
+    }
+    tailp=&next(*tailp);
+  }
+  *tailp = (a!=NULL) ? a : b;	       /* append what is left */
+  return head;
+}
+
+/* relink the chain starting at p into the queue, fixing prev and back */
+static void set_chain(hqueue_t *qp,hlink_t *p) {
+  hlink_t *bp;
+
+  front(qp)=p;
+  for(bp=NULL; p!=NULL; bp=p, p=next(p))
+    prev(p)=bp;
+  back(qp)=bp;
+}
 /* END OF PRIVATE SECTION */
 
 
@@ -122,32 +183,36 @@ void qclose(queue_t *qp) {
  * qadd -- adds an value ep to the back of queue qp
  */
 int32_t qput(queue_t *qp, void *ep) {
-  hlink_t *newp,*bp;
   int32_t rc;
   
-  newp=get_link(qp);                       /* get a new link */
-  if(newp) {                               /* next already null */
-    element(newp) = ep;		/* add queue element to link */
-    bp=back(qp);
-    if(bp) {			    /* list is not empty */
-      next(bp)=newp;                /* change last entry */
-      prev(newp)=bp;                /* previous is old back */
-    }
-    else
-      front(qp) = newp;             /* front of the queue */
-    back(qp) = newp;		    /* new is now queue back */
-  } 
-  if (newp == NULL)
+  if(qput_handle(qp, ep) == NULL)
     rc = -1;
   else
     rc = 0;
   return rc;
 }
 
+/*
+ * qput_handle -- adds a value ep to the back of queue qp and returns
+ * its link as an opaque handle
+ */
+qhandle_t* qput_handle(queue_t *qp, void *ep) {
+  hlink_t *newp;
+  TRACE_BEGIN(TR_QPUT, t);
+  
+  newp=get_link(qp);                       /* get a new link */
+  if(newp) {
+    element(newp) = ep;		/* add queue element to link */
+    append_link(qp,newp);
+  } 
+  TRACE_END(TR_QPUT, t);
+  return (qhandle_t*)newp;
+}
 
 void* qget(queue_t *qp) {
   hlink_t *fp;
   void* ep;
+  TRACE_BEGIN(TR_QGET, t);
   
   fp=front(qp);                        /* find front of queue */
   if(fp) {                             /* queue not empty */
@@ -161,9 +226,95 @@ void* qget(queue_t *qp) {
   }
   else				/* nothing in queue */
     ep = NULL;			/* nothing to return */
+  TRACE_END(TR_QGET, t);
   return ep;
 }
 
+/*
+ * qput_n -- the links are chained through next in one pass, taking as
+ * many as there are from the free list, and the chain is then spliced
+ * onto the back of the queue at once
+ */
+int32_t qput_n(queue_t *qp, void *elems[], uint64_t n) {
+  hlink_t *head, *p, *bp;
+  uint64_t i;
+
+  if(n == 0)
+    return 0;
+  head=NULL;
+  bp=NULL;
+  for(i=0; i<n; i++) {
+    if(qfree(qp) != NULL) {	/* recycle a free link */
+      p=qfree(qp);
+      qfree(qp)=next(p);
+      spaces(qp)++;
+    }
+    else if((p=(hlink_t*)malloc(sizeof(hlink_t))) == NULL) {
+      for(p=head; p!=NULL; p=head) { /* give back what was taken */
+	head=next(p);
+	free_link(qp,p);
+      }
+      return -1;
+    }
+    element(p)=elems[i];
+    prev(p)=bp;
+    if(bp)
+      next(bp)=p;
+    else
+      head=p;
+    bp=p;
+  }
+  next(bp)=NULL;
+  prev(head)=back(qp);		/* splice onto the back */
+  if(back(qp))
+    next(back(qp))=head;
+  else
+    front(qp)=head;
+  back(qp)=bp;
+  return 0;
+}
+
+/*
+ * qget_n -- the front of the queue is cut off in one pass, and its
+ * links then go to the free list as a single chain, any surplus being
+ * free'd
+ */
+uint64_t qget_n(queue_t *qp, void *out[], uint64_t max) {
+  hlink_t *head, *p, *lastp;
+  uint64_t n, k;
+
+  head=front(qp);
+  for(n=0, lastp=NULL, p=head; p!=NULL && n<max; lastp=p, p=next(p))
+    out[n++]=element(p);
+  if(n == 0)
+    return 0;
+  front(qp)=p;			/* cut after lastp */
+  if(p)
+    prev(p)=NULL;
+  else
+    back(qp)=NULL;
+  next(lastp)=NULL;
+  if(spaces(qp) > 0) {		/* the free list takes k links */
+    for(k=1, p=head; k<(uint64_t)spaces(qp) && next(p)!=NULL; k++)
+      p=next(p);
+    lastp=next(p);
+    next(p)=qfree(qp);
+    qfree(qp)=head;
+    spaces(qp)-=(int)k;
+  }
+  else
+    lastp=head;
+  for(p=lastp; p!=NULL; p=lastp) { /* free the rest */
+    lastp=next(p);
+    free(p);
+  }
+  return n;
+}
+
+uint64_t qdrain(queue_t *qp, void *out[]) {
+  return qget_n(qp, out, UINT64_MAX);
+}
+
 /*
  * qapply -- applies a function to every element of the queue 
  */
@@ -185,6 +336,7 @@ void* qsearch(queue_t *qp,
   hlink_t *p;
   void *result;
   bool found;
+  TRACE_BEGIN(TR_QSEARCH, t);
   
   result=NULL;
   for(found=false, p=front(qp) ; 
@@ -193,6 +345,7 @@ void* qsearch(queue_t *qp,
     ;                                    /* apply fn to all  */
   if(found) 
     result=element(p);
+  TRACE_END(TR_QSEARCH, t);
   return result;
 }
 
@@ -214,19 +367,88 @@ void* qremove(queue_t *qp,
     ;				/* apply fn to all  */
   if(found) {
     result=element(p);
-    if(prev(p))			       /* something before p? */
-      next(prev(p)) = next(p);         /* prev points past p */
-    else			       /* p is front of q */
-      front(qp) = next(p);             /* set new front */
-    if(next(p))			       /* something after p? */
-      prev(next(p)) = prev(p);         /* next points past p */
-    else			       /* p is back of q */
-      back(qp) = prev(p);              /* set new back */
+    cut_link(qp,p);		       /* take p out of the queue */
     free_link(qp,p);		       /* add link to free list */
   }
   return result;
 }
 
+/*
+ * qremove_handle -- removes and returns the element at the link h
+ * without searching
+ */
+void* qremove_handle(queue_t *qp, qhandle_t *h) {
+  hlink_t *p;
+  void *result;
+
+  p=(hlink_t*)h;
+  result=element(p);
+  cut_link(qp,p);		       /* take p out of the queue */
+  free_link(qp,p);		       /* add link to free list */
+  return result;
+}
+
+/*
+ * qmove_to_back -- relinks h at the back of the queue
+ */
+void qmove_to_back(queue_t *qp, qhandle_t *h) {
+  hlink_t *p;
+
+  p=(hlink_t*)h;
+  if(back(qp) != p) {		       /* already at back -- nothing to do */
+    cut_link(qp,p);
+    append_link(qp,p);
+  }
+}
+
+/*
+ * qpeek -- the front element, left in place
+ */
+void* qpeek(queue_t *qp) {
+  if(front(qp) == NULL)
+    return NULL;
+  return element(front(qp));
+}
+
+/*
+ * qtransfer -- relinks the front link of q2 at the back of q1
+ */
+void* qtransfer(queue_t *q1p, queue_t *q2p) {
+  hlink_t *p;
+
+  p=front(q2p);
+  if(p == NULL)
+    return NULL;
+  cut_link(q2p,p);
+  append_link(q1p,p);
+  return element(p);
+}
+
+/*
+ * qmemusage -- walks the queue and its free list
+ */
+void qmemusage(queue_t *qp, qmem_t *mp) {
+  hlink_t *p;
+
+  mp->header += sizeof(hqueue_t);
+  for(p=front(qp); p!=NULL; p=next(p))
+    mp->links += sizeof(hlink_t);
+  for(p=qfree(qp); p!=NULL; p=next(p))
+    mp->freelinks += sizeof(hlink_t);
+}
+
+uint64_t qtrim(queue_t *qp) {
+  hlink_t *p;
+  uint64_t bytes;
+
+  for(bytes=0; (p=qfree(qp)) != NULL; bytes+=sizeof(hlink_t)) {
+    qfree(qp) = next(p);
+    free(p);
+    spaces(qp)++;		/* room for it again, within the limit */
+  }
+  return bytes;
+}
+
 /*
  * qconcat -- concatenate q2 into q1 -- q2 is no longer valid after
  * this operation 
@@ -256,6 +478,44 @@ void qconcat(queue_t *q1p, queue_t *q2p) {
   free(q2p);                              /* deallocate q2 */
 }
 
+/*
+ * qsort_by -- bottom-up merge sort of the links themselves; bins[i]
+ * holds a sorted run of 2^i links, older than any in lower bins
+ */
+void qsort_by(queue_t *qp, int (*cmpfn)(void *e1p, void *e2p)) {
+  hlink_t *bins[64], *p, *carry;
+  int i,maxbin;
+
+  maxbin=0;
+  for(p=front(qp); p!=NULL; ) {
+    carry=p;			       /* detach p as a run of one */
+    p=next(p);
+    next(carry)=NULL;
+    for(i=0; i<maxbin && bins[i]!=NULL; i++) {
+      carry=merge_links(bins[i],carry,cmpfn);
+      bins[i]=NULL;
+    }
+    if(i==maxbin)
+      maxbin++;
+    bins[i]=carry;
+  }
+  for(carry=NULL, i=0; i<maxbin; i++)  /* merge runs, youngest first */
+    if(bins[i]!=NULL)
+      carry=merge_links(bins[i],carry,cmpfn);
+  set_chain(qp,carry);
+}
+
+/*
+ * qmerge -- merge two sorted queues, then dispose of q2 as qconcat
+ * does
+ */
+void qmerge(queue_t *q1p, queue_t *q2p, int (*cmpfn)(void *e1p, void *e2p)) {
+  set_chain(q1p,merge_links(front(q1p),front(q2p),cmpfn));
+  front(q2p)=NULL;		       /* its links now belong to q1 */
+  back(q2p)=NULL;
+  qconcat(q1p,q2p);
+}
+
 #ifdef FREESPACES
 /* manipulation of the number of free links kept */
 void qsetfreespaces(queue_t *qp, int cnt) {
@@ -46,8 +46,92 @@ void* qremove(queue_t *qp,
 							bool (*searchfn)(void* elementp,const void* keyp),
 							const void* skeyp);
 
+/* a handle on the position of an element in a queue -- its
+ * representation is hidden from users of the module
+ */
+typedef void qhandle_t;
+
+/* put element at the end of the queue (as in qput)
+ * returns a handle to the element's position in the queue, or NULL if
+ * unsuccessful; the handle stays valid until the element leaves the
+ * queue (including across qconcat and qmove_to_back)
+ */
+qhandle_t* qput_handle(queue_t *qp, void *elementp);
+
+/* removes the element designated by handle h from the queue in O(1)
+ * and returns a pointer to it; h is no longer valid afterwards
+ */
+void* qremove_handle(queue_t *qp, qhandle_t *h);
+
+/* moves the element designated by handle h to the back of the queue
+ * in O(1); h remains valid
+ */
+void qmove_to_back(queue_t *qp, qhandle_t *h);
+
+/* returns the first element of the queue without removing it, or
+ * NULL if the queue is empty
+ */
+void* qpeek(queue_t *qp);
+
+/* moves the first element of q2 to the back of q1 in O(1) without
+ * allocating; its handle remains valid
+ * returns a pointer to the element moved, or NULL if q2 is empty
+ */
+void* qtransfer(queue_t *q1p, queue_t *q2p);
+
+/* puts the n elements of elems at the end of the queue, in order,
+ * taking links from the free list first and allocating the rest one
+ * at a time, then splicing them all on at once
+ * returns 0 if successful; nonzero otherwise, with none of them put
+ */
+int32_t qput_n(queue_t *qp, void *elems[], uint64_t n);
+
+/* gets up to max elements from the front of the queue into out, in
+ * order, removing them from the queue
+ * returns the number of elements got
+ */
+uint64_t qget_n(queue_t *qp, void *out[], uint64_t max);
+
+/* gets every element of the queue into out, which must have room for
+ * them all, leaving the queue empty
+ * returns the number of elements got
+ */
+uint64_t qdrain(queue_t *qp, void *out[]);
+
 /* concatenatenates elements of q2 into q1
  * q2 is dealocated, closed, and unusable upon completion 
  */
 void qconcat(queue_t *q1p, queue_t *q2p);
 
+
+/* bytes of memory held by a queue, by category -- as requested from
+ * malloc, not counting the allocator's own overhead
+ */
+typedef struct {
+  uint64_t header;		/* the queue structure */
+  uint64_t links;		/* links holding elements */
+  uint64_t freelinks;		/* links cached for reuse */
+} qmem_t;
+
+/* adds the memory held by the queue (but not by its elements) to the
+ * counts in *mp
+ */
+void qmemusage(queue_t *qp, qmem_t *mp);
+
+/* frees the links the queue has cached for reuse
+ * returns the number of bytes released
+ */
+uint64_t qtrim(queue_t *qp);
+
+/* sorts the queue in place using a supplied comparison function,
+ * keeping elements that compare equal in their original order
+ * cmpfn -- returns <0, 0 or >0 as e1p sorts before, with or after e2p
+ * handles to elements in the queue remain valid
+ */
+void qsort_by(queue_t *qp, int (*cmpfn)(void *e1p, void *e2p));
+
+/* merges the elements of q2 into q1, both already sorted by cmpfn;
+ * on ties elements of q1 come first
+ * q2 is dealocated, closed, and unusable upon completion (as in qconcat)
+ */
+void qmerge(queue_t *q1p, queue_t *q2p, int (*cmpfn)(void *e1p, void *e2p));
@@ -0,0 +1,470 @@
+/*
+ * shash.c -- implements a hash table in a POSIX shared memory region.
+ * Everything in the region is addressed by offsets from its start, as
+ * each process maps it at its own address.
+ *
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <shash.h>
+#include <hashfn.h>
+
+#define SHASH_READY 0x7368617368726479ULL /* "shashrdy": set up */
+#define SHASH_VERSION 1
+#define ATTACH_TIMEOUT 1000	/* ms to wait for a creator to finish */
+#define ATTACH_LIMIT 10000	/* ms to wait for a live one, at most */
+#define READ_TRIES 64		/* lock-free read attempts before locking */
+#define MIN_BLOCK 32		/* smallest storage block */
+#define NCLASSES 40		/* block sizes MIN_BLOCK << 0..NCLASSES-1 */
+#define ALIGN 64		/* of the buckets and the storage */
+
+
+/* PRIVATE SECTION */
+
+/*
+ * The region holds a header, then hsize bucket offsets, then storage.
+ * Each entry is one block of storage, a power of 2 in size; freed
+ * blocks are kept on a free list per size. Writers hold the robust,
+ * process-shared lock and make the sequence number odd while they
+ * change anything, so readers copying a value out without the lock
+ * can tell if a write overlapped (a seqlock). Readers check every
+ * offset they follow against the region, as a torn read may see
+ * anything; what they copy then is thrown away.
+ */
+typedef struct {
+  _Atomic uint64_t magic;	/* SHASH_READY once set up */
+  _Atomic int32_t initpid;	/* the process setting it up */
+  uint32_t version;
+  uint64_t size;		/* bytes in the region */
+  uint64_t hsize;		/* number of buckets */
+  uint64_t heap;		/* offset of the storage */
+  uint64_t top;			/* offset of storage never used */
+  uint64_t freelist[NCLASSES];	/* freed blocks of each size */
+  uint64_t entries;
+  uint32_t seed;		/* of the hash */
+  _Atomic uint64_t seq;		/* odd while a write is in progress */
+  pthread_mutex_t lock;		/* held by writers */
+} shdr_t;
+
+/* an entry, at a non-zero offset in the storage */
+typedef struct {
+  uint64_t next;		/* next entry in the chain, or 0 */
+  uint32_t hash;		/* full hash of the key */
+  uint32_t cls;			/* block is MIN_BLOCK << cls bytes */
+  int32_t keylen;
+  int32_t vallen;
+  char data[];			/* key, then value */
+} sentry_t;
+
+/* a process's view of a table */
+typedef struct {
+  char *base;			/* where the region is mapped */
+  uint64_t size;		/* and its size */
+} shandle_t;
+
+/* accessor macros */
+#define sbase(shp) (((shandle_t*)shp)->base)
+#define ssize(shp) (((shandle_t*)shp)->size)
+#define shdr(shp) ((shdr_t*)sbase(shp))
+#define sbuckets(hp) ((uint64_t*)((char*)(hp) + buckets_offset()))
+#define sentry(hp,o) ((sentry_t*)((char*)(hp) + (o)))
+
+#define align(n) (((n) + ALIGN-1) / ALIGN * ALIGN)
+#define buckets_offset() align(sizeof(shdr_t))
+#define block_size(cls) ((uint64_t)MIN_BLOCK << (cls))
+
+/*
+ * hidden helper functions
+ */
+
+static uint64_t region_size(uint64_t hsize, uint64_t bytes) {
+  return align(buckets_offset() + hsize*sizeof(uint64_t)) + bytes;
+}
+
+static uint32_t hash_key(shdr_t *hp, const char *key, int32_t keylen) {
+  return SuperFastHashSeeded(key, keylen, hp->seed);
+}
+
+/* empty the buckets and storage */
+static void clear_table(shdr_t *hp) {
+  memset(sbuckets(hp), 0, hp->hsize*sizeof(uint64_t));
+  memset(hp->freelist, 0, sizeof(hp->freelist));
+  hp->top = hp->heap;
+  hp->entries = 0;
+}
+
+/* set up a table in a region of size bytes */
+static int32_t init_table(shdr_t *hp, uint64_t size, uint64_t hsize) {
+  pthread_mutexattr_t attr;
+  uint64_t seed[2];
+  int32_t rc;
+
+  hp->version = SHASH_VERSION;
+  hp->size = size;
+  hp->hsize = hsize;
+  hp->heap = align(buckets_offset() + hsize*sizeof(uint64_t));
+  RandomSeed(seed);
+  hp->seed = (uint32_t)seed[0];
+  atomic_store(&hp->seq, 0);
+  clear_table(hp);
+  if(pthread_mutexattr_init(&attr) != 0)
+    return -1;
+  rc = 0;
+  if(pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+     pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0 ||
+     pthread_mutex_init(&hp->lock, &attr) != 0)
+    rc = -1;
+  pthread_mutexattr_destroy(&attr);
+  if(rc == 0)
+    atomic_store_explicit(&hp->magic, SHASH_READY, memory_order_release);
+  return rc;
+}
+
+/*
+ * lock_table -- if the last holder died, the table is only suspect
+ * if it died mid-write (the sequence number is odd); a suspect table
+ * is emptied, since its chains cannot be trusted
+ */
+static int32_t lock_table(shdr_t *hp) {
+  int rc;
+
+  rc = pthread_mutex_lock(&hp->lock);
+  if(rc == EOWNERDEAD) {
+    if(atomic_load(&hp->seq) & 1) {
+      clear_table(hp);
+      atomic_fetch_add(&hp->seq, 1);
+    }
+    pthread_mutex_consistent(&hp->lock);
+    rc = 0;
+  }
+  return rc == 0 ? 0 : -1;
+}
+
+static void write_begin(shdr_t *hp) {
+  atomic_fetch_add_explicit(&hp->seq, 1, memory_order_acq_rel);
+}
+
+static void write_end(shdr_t *hp) {
+  atomic_fetch_add_explicit(&hp->seq, 1, memory_order_release);
+}
+
+/* could an entry start at offset o? */
+static bool valid_entry(shdr_t *hp, uint64_t size, uint64_t o) {
+  return o >= hp->heap && o < size && size - o >= sizeof(sentry_t);
+}
+
+/*
+ * find -- the link (bucket or next field) pointing to the entry under
+ * key, or to 0 at the end of the chain if there is none; for writers,
+ * so the table is known to be consistent
+ */
+static uint64_t *find(shdr_t *hp, const char *key, int32_t keylen,
+		      uint32_t h) {
+  uint64_t *linkp;
+  sentry_t *ep;
+
+  for(linkp=&sbuckets(hp)[h % hp->hsize]; *linkp != 0; linkp=&ep->next) {
+    ep = sentry(hp, *linkp);
+    if(ep->hash == h && ep->keylen == keylen &&
+       memcmp(ep->data, key, keylen) == 0)
+      break;
+  }
+  return linkp;
+}
+
+/*
+ * read_value -- find's work for readers, which may race a writer:
+ * every offset and length is checked before use, and the walk is
+ * bounded, so a torn read returns nonsense rather than faulting
+ */
+static int32_t read_value(shandle_t *shp, const char *key, int32_t keylen,
+			  uint32_t h, void *buf, int32_t bufsize) {
+  shdr_t *hp = shdr(shp);
+  uint64_t o, steps, room;
+  sentry_t *ep;
+
+  o = sbuckets(hp)[h % hp->hsize];
+  for(steps=0; o != 0 && steps <= ssize(shp)/MIN_BLOCK; steps++) {
+    if(!valid_entry(hp, ssize(shp), o))
+      return -1;
+    ep = sentry(hp, o);
+    room = ssize(shp) - o - sizeof(sentry_t);
+    if(ep->hash == h && ep->keylen == keylen && (uint64_t)keylen <= room &&
+       memcmp(ep->data, key, keylen) == 0) {
+      if(ep->vallen < 0 || (uint64_t)ep->vallen > room - keylen)
+	return -1;
+      memcpy(buf, ep->data + keylen,
+	     ep->vallen < bufsize ? ep->vallen : bufsize);
+      return ep->vallen;
+    }
+    o = ep->next;
+  }
+  return -1;
+}
+
+/* take a block of at least need bytes from the storage, or 0 */
+static uint64_t alloc_block(shdr_t *hp, uint64_t need) {
+  uint32_t cls;
+  uint64_t o;
+
+  for(cls=0; cls<NCLASSES && block_size(cls) < need; cls++)
+    ;
+  if(cls == NCLASSES)
+    return 0;
+  if((o = hp->freelist[cls]) != 0)
+    hp->freelist[cls] = sentry(hp, o)->next;
+  else if(hp->size - hp->top >= block_size(cls)) {
+    o = hp->top;
+    hp->top += block_size(cls);
+  }
+  else
+    return 0;
+  sentry(hp, o)->cls = cls;
+  return o;
+}
+
+static void free_block(shdr_t *hp, uint64_t o) {
+  sentry_t *ep = sentry(hp, o);
+
+  ep->next = hp->freelist[ep->cls];
+  hp->freelist[ep->cls] = o;
+}
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000 + (uint64_t)ts.tv_nsec/1000000;
+}
+
+/* is the process that claimed to be setting the table up gone? */
+static bool gone(int32_t pid) {
+  return pid == 0 || (kill(pid, 0) != 0 && errno == ESRCH);
+}
+
+/*
+ * attach -- map the table open on fd, setting it up if no live
+ * process is; size and hsize are what to set it up with. A process
+ * claims the set up by swapping its pid into initpid: the creator
+ * does so at once, and others only once ATTACH_TIMEOUT has passed
+ * without the table becoming ready and the claimant is gone, which
+ * also covers a creator that died before it could claim. A claimant
+ * still alive after ATTACH_LIMIT (stopped, hung, or its pid reused)
+ * is given up on. A ready table is only used if it is of this
+ * version and the size it says it is
+ */
+static shandle_t *attach(int fd, bool creator, uint64_t size,
+			 uint64_t hsize) {
+  shandle_t *shp;
+  shdr_t *hp;
+  struct stat st;
+  uint64_t deadline, limit;
+  int32_t pid;
+  struct timespec pause = { 0, 1000000 };
+
+  shp = malloc(sizeof(shandle_t));
+  if(shp == NULL)
+    return NULL;
+  sbase(shp) = NULL;
+  deadline = creator ? 0 : now_ms() + ATTACH_TIMEOUT;
+  limit = now_ms() + ATTACH_LIMIT;
+  for(;;) {
+    if(fstat(fd, &st) != 0)
+      break;
+    if(sbase(shp) == NULL && (uint64_t)st.st_size < sizeof(shdr_t) &&
+       now_ms() >= deadline && ftruncate(fd, size) == 0)
+      continue;			/* creator died before sizing it */
+    if(sbase(shp) == NULL && (uint64_t)st.st_size >= sizeof(shdr_t)) {
+      ssize(shp) = st.st_size;
+      sbase(shp) = mmap(NULL, ssize(shp), PROT_READ|PROT_WRITE, MAP_SHARED,
+			fd, 0);
+      if(sbase(shp) == MAP_FAILED)
+	break;
+    }
+    if(sbase(shp) != NULL) {
+      hp = shdr(shp);
+      if(atomic_load_explicit(&hp->magic, memory_order_acquire) ==
+	 SHASH_READY) {
+	if(hp->version != SHASH_VERSION || hp->size != ssize(shp))
+	  break;		/* another layout, or resized */
+	return shp;
+      }
+      pid = atomic_load(&hp->initpid);
+      if(now_ms() >= deadline && gone(pid) &&
+	 atomic_compare_exchange_strong(&hp->initpid, &pid, getpid())) {
+	if(region_size(hsize, 0) > ssize(shp))
+	  hsize = 1;		/* sized by someone else */
+	if(region_size(hsize, 0) > ssize(shp) ||
+	   init_table(hp, ssize(shp), hsize) != 0)
+	  break;
+	return shp;
+      }
+    }
+    if(now_ms() >= limit)
+      break;			/* the claimant is stuck */
+    nanosleep(&pause, NULL);
+  }
+  if(sbase(shp) != NULL && sbase(shp) != MAP_FAILED)
+    munmap(sbase(shp), ssize(shp));
+  free(shp);
+  return NULL;
+}
+/* END OF PRIVATE SECTION */
+
+
+
+/* PUBLIC SECTION */
+
+shashtable_t *hopen_shared(const char *name, uint64_t hsize, uint64_t bytes) {
+  shandle_t *shp;
+  uint64_t size;
+  bool creator;
+  int fd;
+
+  if(hsize == 0)
+    hsize = 1;
+  size = region_size(hsize, bytes);
+  fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+  creator = (fd >= 0);
+  if(creator) {
+    if(ftruncate(fd, size) != 0) {
+      close(fd);
+      shm_unlink(name);
+      return NULL;
+    }
+  }
+  else if(errno != EEXIST || (fd = shm_open(name, O_RDWR, 0600)) < 0)
+    return NULL;
+  shp = attach(fd, creator, size, hsize);
+  close(fd);			/* the mapping stays */
+  return (shashtable_t*)shp;
+}
+
+void hclose_shared(shashtable_t *shp) {
+  munmap(sbase(shp), ssize(shp));
+  free(shp);
+}
+
+int32_t hunlink_shared(const char *name) {
+  return shm_unlink(name) == 0 ? 0 : -1;
+}
+
+/*
+ * hput_shared -- a value that fits the entry's block is overwritten
+ * in place; otherwise a new entry takes the old one's place in the
+ * chain
+ */
+int32_t hput_shared(shashtable_t *shp, const char *key, int32_t keylen,
+		    const void *val, int32_t vallen) {
+  shdr_t *hp = shdr(shp);
+  uint64_t *linkp, o, need;
+  sentry_t *ep, *oldp;
+  uint32_t h;
+  int32_t rc;
+
+  if(keylen < 0 || vallen < 0)
+    return -1;
+  h = hash_key(hp, key, keylen);
+  need = sizeof(sentry_t) + (uint64_t)keylen + vallen;
+  if(lock_table(hp) != 0)
+    return -1;
+  write_begin(hp);
+  rc = 0;
+  linkp = find(hp, key, keylen, h);
+  oldp = (*linkp != 0) ? sentry(hp, *linkp) : NULL;
+  if(oldp != NULL && block_size(oldp->cls) >= need) {
+    memcpy(oldp->data + keylen, val, vallen);
+    oldp->vallen = vallen;
+  }
+  else if((o = alloc_block(hp, need)) == 0)
+    rc = -1;			/* out of storage */
+  else {
+    ep = sentry(hp, o);
+    ep->hash = h;
+    ep->keylen = keylen;
+    ep->vallen = vallen;
+    memcpy(ep->data, key, keylen);
+    memcpy(ep->data + keylen, val, vallen);
+    if(oldp != NULL) {		/* replace */
+      ep->next = oldp->next;
+      free_block(hp, *linkp);
+      *linkp = o;
+    }
+    else {			/* push on the front of the chain */
+      ep->next = sbuckets(hp)[h % hp->hsize];
+      sbuckets(hp)[h % hp->hsize] = o;
+      hp->entries++;
+    }
+  }
+  write_end(hp);
+  pthread_mutex_unlock(&hp->lock);
+  return rc;
+}
+
+/*
+ * hget_shared -- lock-free while writes do not overlap the read;
+ * after READ_TRIES overlapping writes (or one that never ends, its
+ * writer having died) it takes the lock instead
+ */
+int32_t hget_shared(shashtable_t *shp, const char *key, int32_t keylen,
+		    void *buf, int32_t bufsize) {
+  shdr_t *hp = shdr(shp);
+  uint64_t seq;
+  uint32_t h;
+  int32_t rc, tries;
+
+  h = hash_key(hp, key, keylen);
+  for(tries=0; tries<READ_TRIES; tries++) {
+    seq = atomic_load_explicit(&hp->seq, memory_order_acquire);
+    if(seq & 1)
+      continue;			/* a write is in progress */
+    rc = read_value((shandle_t*)shp, key, keylen, h, buf, bufsize);
+    atomic_thread_fence(memory_order_acquire);
+    if(atomic_load_explicit(&hp->seq, memory_order_relaxed) == seq)
+      return rc;
+  }
+  if(lock_table(hp) != 0)
+    return -1;
+  rc = read_value((shandle_t*)shp, key, keylen, h, buf, bufsize);
+  pthread_mutex_unlock(&hp->lock);
+  return rc;
+}
+
+int32_t hremove_shared(shashtable_t *shp, const char *key, int32_t keylen) {
+  shdr_t *hp = shdr(shp);
+  uint64_t *linkp, o;
+  uint32_t h;
+
+  h = hash_key(hp, key, keylen);
+  if(lock_table(hp) != 0)
+    return -1;
+  write_begin(hp);
+  linkp = find(hp, key, keylen, h);
+  o = *linkp;
+  if(o != 0) {
+    *linkp = sentry(hp, o)->next;
+    free_block(hp, o);
+    hp->entries--;
+  }
+  write_end(hp);
+  pthread_mutex_unlock(&hp->lock);
+  return o != 0 ? 0 : -1;
+}
+
+uint64_t hentries_shared(shashtable_t *shp) {
+  return shdr(shp)->entries;
+}
+
+/* END OF PUBLIC SECTION */
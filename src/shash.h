@@ -0,0 +1,56 @@
+#pragma once
+/*
+ * shash.h -- A hash table in named shared memory, which any number of
+ * processes on a host may open and use at once. Keys and values are
+ * copied into the table's region, as no pointer means the same thing
+ * in two processes. Writers take a process-shared lock; readers copy
+ * values out without it, retrying if a write overlapped.
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void shashtable_t;	/* representation of a table hidden */
+
+/* hopen_shared -- opens the shared table called name (a POSIX shared
+ * memory name, "/like-this"), creating it with hsize buckets and
+ * bytes bytes of key and value storage if it does not exist; opening
+ * an existing table waits for its creator to finish setting it up,
+ * and takes over if the creator died doing so -- returns NULL on
+ * failure, if the creator is still alive but not done after 10
+ * seconds, or if the table is of another version or has been resized
+ */
+shashtable_t *hopen_shared(const char *name, uint64_t hsize, uint64_t bytes);
+
+/* hclose_shared -- detaches from a shared table; it lives on, until
+ * unlinked, for other processes
+ */
+void hclose_shared(shashtable_t *shp);
+
+/* hunlink_shared -- removes the name of a shared table, which is
+ * freed once every process has closed it
+ * returns 0 for success; non-zero otherwise
+ */
+int32_t hunlink_shared(const char *name);
+
+/* hput_shared -- puts a copy of the value under a copy of the key,
+ * replacing any value already there
+ * returns 0 for success; non-zero otherwise (e.g. out of storage)
+ */
+int32_t hput_shared(shashtable_t *shp, const char *key, int32_t keylen,
+		    const void *val, int32_t vallen);
+
+/* hget_shared -- copies the value under key into buf, truncated to
+ * bufsize bytes -- returns the length of the whole value, or -1 if
+ * there is none
+ */
+int32_t hget_shared(shashtable_t *shp, const char *key, int32_t keylen,
+		    void *buf, int32_t bufsize);
+
+/* hremove_shared -- removes the value under key
+ * returns 0 for success; non-zero if there was none
+ */
+int32_t hremove_shared(shashtable_t *shp, const char *key, int32_t keylen);
+
+/* hentries_shared -- the number of keys in the table */
+uint64_t hentries_shared(shashtable_t *shp);
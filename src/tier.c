@@ -0,0 +1,564 @@
+/*
+ * tier.c -- implements a tiered table: a cache of nodes in memory
+ * whose evictions are appended to a memory-mapped log file, indexed
+ * by an open-addressed table in a second mapped file.
+ *
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <queue.h>
+#include <cache.h>
+#include <hashfn.h>
+#include <tier.h>
+
+#define LOG_START 8		/* offsets below mark free index slots */
+#define EMPTY 0			/* index slot never used */
+#define TOMB 1			/* index slot whose record went away */
+#define MIN_LOG (1 << 16)	/* initial and least log file size */
+#define MIN_SLOTS 64		/* initial index slots */
+#define COMPACT_STEP (1 << 16)	/* bytes of log compacted per demotion */
+#define COMPACT_MIN (1 << 16)	/* dead bytes worth compacting */
+
+
+/* PRIVATE SECTION */
+
+/*
+ * The log holds records back to back from LOG_START, each 8-byte
+ * aligned. A record is never rewritten except to clear its live flag
+ * when it is removed or promoted; compaction reclaims the space by
+ * sliding live records down over dead ones, a budget at a time:
+ * records before wr are done, those from rd on still to do, and the
+ * gap between is garbage. The index maps a key's hash to the offset
+ * of its record with linear probing, kept at most half full; it can
+ * always be rebuilt from the live records, which is how it grows and
+ * sheds removed slots. An entry evicted when the log cannot take it
+ * (the disk is full) is not dropped but stranded: kept in memory,
+ * outside the hot tier's limit, until a later put finds room for it.
+ */
+typedef struct {
+  uint32_t keylen;
+  uint32_t vallen;
+  uint32_t hash;
+  uint32_t live;		/* cleared once removed or promoted */
+  char data[];			/* key, then value */
+} record_t;
+
+typedef struct {
+  uint64_t off;			/* of the record, or EMPTY or TOMB */
+  uint64_t hash;
+} slot_t;
+
+struct htier;
+
+/* an entry of the hot tier */
+typedef struct {
+  struct htier *tier;		/* for demotion */
+  uint32_t hash;
+  int32_t keylen;
+  int32_t vallen;
+  char data[];			/* key, then value */
+} tnode_t;
+
+/* a key, for searching the stranded entries */
+typedef struct {
+  const char *key;
+  int32_t keylen;
+} tkey_t;
+
+/* the hidden structure of a tiered table */
+typedef struct htier {
+  cache_t *hot;			/* key -> node */
+  queue_t *stranded;		/* evicted nodes the log could not take */
+  uint64_t nstranded;		/* and how many */
+  uint64_t strandedbytes;	/* charged */
+  uint32_t seed;		/* per-table key for the hash function */
+  bool closing;			/* evictions are not demotions */
+  int logfd;
+  char *log;			/* the mapped log */
+  uint64_t logsize;		/* and its size */
+  uint64_t top;			/* end of the records */
+  int idxfd;
+  slot_t *idx;			/* the mapped index */
+  uint64_t nslots;
+  uint64_t used;		/* slots not EMPTY */
+  uint64_t cold;		/* records live */
+  uint64_t livebytes;		/* of the log, live */
+  uint64_t deadbytes;		/* and dead */
+  bool compacting;
+  uint64_t rd;			/* next record to compact */
+  uint64_t wr;			/* and where it goes */
+  uint64_t demotions;
+  uint64_t promotions;
+  uint64_t lost;
+} htier_t;
+
+/* accessor macros */
+#define thot(tp) (((htier_t*)tp)->hot)
+#define tstranded(tp) (((htier_t*)tp)->stranded)
+#define tnstranded(tp) (((htier_t*)tp)->nstranded)
+#define tstrandedbytes(tp) (((htier_t*)tp)->strandedbytes)
+#define tseed(tp) (((htier_t*)tp)->seed)
+#define tclosing(tp) (((htier_t*)tp)->closing)
+#define tlogfd(tp) (((htier_t*)tp)->logfd)
+#define tlog(tp) (((htier_t*)tp)->log)
+#define tlogsize(tp) (((htier_t*)tp)->logsize)
+#define ttop(tp) (((htier_t*)tp)->top)
+#define tidxfd(tp) (((htier_t*)tp)->idxfd)
+#define tidx(tp) (((htier_t*)tp)->idx)
+#define tnslots(tp) (((htier_t*)tp)->nslots)
+#define tused(tp) (((htier_t*)tp)->used)
+#define tcold(tp) (((htier_t*)tp)->cold)
+#define tlivebytes(tp) (((htier_t*)tp)->livebytes)
+#define tdeadbytes(tp) (((htier_t*)tp)->deadbytes)
+#define tcompacting(tp) (((htier_t*)tp)->compacting)
+#define trd(tp) (((htier_t*)tp)->rd)
+#define twr(tp) (((htier_t*)tp)->wr)
+#define tdemotions(tp) (((htier_t*)tp)->demotions)
+#define tpromotions(tp) (((htier_t*)tp)->promotions)
+#define tlost(tp) (((htier_t*)tp)->lost)
+
+#define record_at(tp,o) ((record_t*)(tlog(tp) + (o)))
+#define record_size(keylen,vallen) \
+  ((sizeof(record_t) + (uint64_t)(keylen) + (vallen) + 7) & ~(uint64_t)7)
+#define charge(np) (sizeof(tnode_t) + (np)->keylen + (np)->vallen)
+#define thashfn(tp,key,keylen) SuperFastHashSeeded(key, keylen, tseed(tp))
+
+/*
+ * hidden helper functions
+ */
+
+/* size the file fd and map it afresh, unmapping the old mapping; the
+ * space is allocated before it is mapped, so a full disk fails here
+ * rather than faulting on the first store to a page
+ */
+static void *remap(int fd, void *old, uint64_t oldsize, uint64_t size) {
+  void *p;
+
+  if(size > oldsize) {
+    if(posix_fallocate(fd, oldsize, size - oldsize) != 0)
+      return NULL;
+  }
+  else if(ftruncate(fd, size) != 0)
+    return NULL;
+  p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED)
+    return NULL;
+  if(old != NULL)
+    munmap(old, oldsize);
+  return p;
+}
+
+/* put the record at o, known to be absent, in a free slot */
+static void place(htier_t *tp, uint64_t hash, uint64_t o) {
+  uint64_t i;
+
+  for(i=hash % tnslots(tp); tidx(tp)[i].off > TOMB; i=(i+1) % tnslots(tp))
+    ;
+  if(tidx(tp)[i].off == EMPTY)
+    tused(tp)++;
+  tidx(tp)[i].off = o;
+  tidx(tp)[i].hash = hash;
+}
+
+/* rebuild the index with nslots slots from the live records */
+static int32_t rebuild_index(htier_t *tp, uint64_t nslots) {
+  slot_t *idx;
+  record_t *rp;
+  uint64_t o;
+
+  idx = remap(tidxfd(tp), tidx(tp), tnslots(tp)*sizeof(slot_t),
+	      nslots*sizeof(slot_t));
+  if(idx == NULL)
+    return -1;
+  memset(idx, 0, nslots*sizeof(slot_t));
+  tidx(tp) = idx;
+  tnslots(tp) = nslots;
+  tused(tp) = 0;
+  for(o=LOG_START; o<ttop(tp); o+=record_size(rp->keylen, rp->vallen)) {
+    if(tcompacting(tp) && o == twr(tp) && (o = trd(tp)) >= ttop(tp))
+      break;			/* skip the gap */
+    rp = record_at(tp, o);
+    if(rp->live)
+      place(tp, rp->hash, o);
+  }
+  return 0;
+}
+
+static int32_t insert_slot(htier_t *tp, uint64_t hash, uint64_t o) {
+  if((tused(tp) + 1)*2 > tnslots(tp) &&
+     rebuild_index(tp, tcold(tp)*4 > tnslots(tp) ?
+		   tnslots(tp)*2 : tnslots(tp)) != 0)
+    return -1;
+  place(tp, hash, o);
+  return 0;
+}
+
+/* the slot of the cold record under key, or NULL */
+static slot_t *find_slot(htier_t *tp, const char *key, int32_t keylen,
+			 uint32_t hash) {
+  slot_t *sp;
+  record_t *rp;
+  uint64_t i;
+
+  for(i=hash % tnslots(tp); tidx(tp)[i].off != EMPTY;
+      i=(i+1) % tnslots(tp)) {
+    sp = &tidx(tp)[i];
+    if(sp->off > TOMB && sp->hash == hash) {
+      rp = record_at(tp, sp->off);
+      if(rp->keylen == (uint32_t)keylen &&
+	 memcmp(rp->data, key, keylen) == 0)
+	return sp;
+    }
+  }
+  return NULL;
+}
+
+/* the slot pointing at the record at o */
+static slot_t *slot_of(htier_t *tp, uint32_t hash, uint64_t o) {
+  uint64_t i;
+
+  for(i=hash % tnslots(tp); tidx(tp)[i].off != o; i=(i+1) % tnslots(tp))
+    ;
+  return &tidx(tp)[i];
+}
+
+/* kill the cold record in slot sp */
+static void drop_cold(htier_t *tp, slot_t *sp) {
+  record_t *rp = record_at(tp, sp->off);
+  uint64_t size = record_size(rp->keylen, rp->vallen);
+
+  rp->live = 0;
+  sp->off = TOMB;
+  tcold(tp)--;
+  tlivebytes(tp) -= size;
+  tdeadbytes(tp) += size;
+}
+
+/* slide live records down over dead ones for budget bytes of log */
+static uint64_t compact(htier_t *tp, uint64_t budget) {
+  record_t *rp;
+  uint64_t size, done;
+  char *lp;
+
+  if(!tcompacting(tp)) {
+    if(tdeadbytes(tp) == 0)
+      return 0;
+    tcompacting(tp) = true;
+    trd(tp) = twr(tp) = LOG_START;
+  }
+  for(done=0; trd(tp) < ttop(tp) && (budget == 0 || done < budget);
+      done+=size) {
+    rp = record_at(tp, trd(tp));
+    size = record_size(rp->keylen, rp->vallen);
+    if(rp->live) {
+      if(twr(tp) != trd(tp)) {
+	slot_of(tp, rp->hash, trd(tp))->off = twr(tp);
+	memmove(tlog(tp) + twr(tp), rp, size);
+      }
+      twr(tp) += size;
+    }
+    else
+      tdeadbytes(tp) -= size;
+    trd(tp) += size;
+  }
+  if(trd(tp) < ttop(tp))
+    return ttop(tp) - trd(tp);
+  ttop(tp) = twr(tp);
+  tcompacting(tp) = false;
+  /* give back most of a log that has emptied */
+  if(tlogsize(tp) > MIN_LOG && ttop(tp)*4 < tlogsize(tp)) {
+    size = ttop(tp)*2 > MIN_LOG ? ttop(tp)*2 : MIN_LOG;
+    if((lp = remap(tlogfd(tp), tlog(tp), tlogsize(tp), size)) != NULL) {
+      tlog(tp) = lp;
+      tlogsize(tp) = size;
+    }
+  }
+  return 0;
+}
+
+/* append node np to the log, and index it */
+static int32_t append(htier_t *tp, tnode_t *np) {
+  record_t *rp;
+  uint64_t size, logsize;
+  char *lp;
+
+  size = record_size(np->keylen, np->vallen);
+  if(ttop(tp) + size > tlogsize(tp)) {
+    for(logsize=tlogsize(tp); ttop(tp) + size > logsize; logsize*=2)
+      ;
+    if((lp = remap(tlogfd(tp), tlog(tp), tlogsize(tp), logsize)) == NULL)
+      return -1;
+    tlog(tp) = lp;
+    tlogsize(tp) = logsize;
+  }
+  rp = record_at(tp, ttop(tp));
+  rp->keylen = np->keylen;
+  rp->vallen = np->vallen;
+  rp->hash = np->hash;
+  rp->live = 1;
+  memcpy(rp->data, np->data, np->keylen + np->vallen);
+  if(insert_slot(tp, np->hash, ttop(tp)) != 0)
+    return -1;
+  ttop(tp) += size;
+  tcold(tp)++;
+  tlivebytes(tp) += size;
+  if(tcompacting(tp) ||
+     (tdeadbytes(tp) > COMPACT_MIN && tdeadbytes(tp) > tlivebytes(tp)))
+    compact(tp, COMPACT_STEP);
+  return 0;
+}
+
+/* eviction function of the hot tier: a node the log cannot take is
+ * stranded, and only lost if even that fails
+ */
+static void demote(void *ep) {
+  tnode_t *np = (tnode_t*)ep;
+  htier_t *tp = np->tier;
+
+  if(tclosing(tp)) {
+    free(np);
+    return;
+  }
+  if(append(tp, np) == 0) {
+    tdemotions(tp)++;
+    free(np);
+    return;
+  }
+  if(qput(tstranded(tp), np) == 0) {
+    tnstranded(tp)++;
+    tstrandedbytes(tp) += charge(np);
+    return;
+  }
+  tlost(tp)++;
+  free(np);
+}
+
+static bool is_node(void *ep, const void *searchkeyp) {
+  tnode_t *np = (tnode_t*)ep;
+  const tkey_t *kp = (const tkey_t*)searchkeyp;
+
+  return np->keylen == kp->keylen &&
+    memcmp(np->data, kp->key, kp->keylen) == 0;
+}
+
+/* take the stranded node under key, if any, out of the queue */
+static tnode_t *unstrand(htier_t *tp, const char *key, int32_t keylen) {
+  tkey_t k = { key, keylen };
+  tnode_t *np;
+
+  if(tnstranded(tp) == 0 ||
+     (np = (tnode_t*)qremove(tstranded(tp), is_node, &k)) == NULL)
+    return NULL;
+  tnstranded(tp)--;
+  tstrandedbytes(tp) -= charge(np);
+  return np;
+}
+
+/* move stranded nodes to the log, oldest first, while it takes them */
+static void retry_stranded(htier_t *tp) {
+  tnode_t *np;
+
+  while(tnstranded(tp) > 0) {
+    np = (tnode_t*)qpeek(tstranded(tp));
+    if(append(tp, np) != 0)
+      return;
+    qget(tstranded(tp));
+    tnstranded(tp)--;
+    tstrandedbytes(tp) -= charge(np);
+    tdemotions(tp)++;
+    free(np);
+  }
+}
+
+static tnode_t *make_node(htier_t *tp, const char *key, int32_t keylen,
+			  const void *val, int32_t vallen, uint32_t hash) {
+  tnode_t *np;
+
+  np = malloc(sizeof(tnode_t) + keylen + vallen);
+  if(np == NULL)
+    return NULL;
+  np->tier = tp;
+  np->hash = hash;
+  np->keylen = keylen;
+  np->vallen = vallen;
+  memcpy(np->data, key, keylen);
+  memcpy(np->data + keylen, val, vallen);
+  return np;
+}
+
+static void close_files(htier_t *tp) {
+  if(tlog(tp) != NULL)
+    munmap(tlog(tp), tlogsize(tp));
+  if(tidx(tp) != NULL)
+    munmap(tidx(tp), tnslots(tp)*sizeof(slot_t));
+  if(tlogfd(tp) >= 0)
+    close(tlogfd(tp));
+  if(tidxfd(tp) >= 0)
+    close(tidxfd(tp));
+}
+/* END OF PRIVATE SECTION */
+
+
+
+/* PUBLIC SECTION */
+
+tier_t *tiopen(const char *path, uint32_t hsize, uint64_t maxbytes) {
+  htier_t *tp;
+  uint64_t seed[2];
+  char *idxpath;
+
+  tp = calloc(1, sizeof(htier_t));
+  idxpath = malloc(strlen(path) + sizeof(".idx"));
+  if(tp == NULL || idxpath == NULL) {
+    free(tp);
+    free(idxpath);
+    return NULL;
+  }
+  sprintf(idxpath, "%s.idx", path);
+  tlogfd(tp) = open(path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+  tidxfd(tp) = open(idxpath, O_RDWR|O_CREAT|O_TRUNC, 0600);
+  if(tlogfd(tp) >= 0)
+    unlink(path);
+  if(tidxfd(tp) >= 0)
+    unlink(idxpath);
+  free(idxpath);
+  if(tlogfd(tp) >= 0 && tidxfd(tp) >= 0) {
+    tlog(tp) = remap(tlogfd(tp), NULL, 0, MIN_LOG);
+    tlogsize(tp) = MIN_LOG;
+    tidx(tp) = remap(tidxfd(tp), NULL, 0, MIN_SLOTS*sizeof(slot_t));
+    tnslots(tp) = MIN_SLOTS;
+    thot(tp) = copen(hsize, CACHE_LRU, 0, maxbytes, demote);
+    tstranded(tp) = qopen();
+  }
+  if(tlog(tp) == NULL || tidx(tp) == NULL || thot(tp) == NULL ||
+     tstranded(tp) == NULL) {
+    if(thot(tp) != NULL)
+      cclose(thot(tp));
+    if(tstranded(tp) != NULL)
+      qclose(tstranded(tp));
+    close_files(tp);
+    free(tp);
+    return NULL;
+  }
+  RandomSeed(seed);
+  tseed(tp) = (uint32_t)seed[0];
+  ttop(tp) = LOG_START;
+  return (tier_t*)tp;
+}
+
+void ticlose(tier_t *tp) {
+  tclosing(tp) = true;
+  cclose(thot(tp));
+  qclose(tstranded(tp));	/* freeing the nodes */
+  close_files(tp);
+  free(tp);
+}
+
+/*
+ * tiput -- the old value is taken out of either tier (or the stranded
+ * nodes) first, so the put cannot demote it; stranded nodes get
+ * another chance at the log before the put evicts more
+ */
+int32_t tiput(tier_t *tp, const char *key, int32_t keylen,
+	      const void *val, int32_t vallen) {
+  tnode_t *np;
+  slot_t *sp;
+  uint32_t hash;
+
+  if(keylen < 0 || vallen < 0)
+    return -1;
+  hash = thashfn(tp, key, keylen);
+  if((np = make_node(tp, key, keylen, val, vallen, hash)) == NULL)
+    return -1;
+  free(cremove(thot(tp), key, keylen));
+  free(unstrand(tp, key, keylen));
+  if((sp = find_slot(tp, key, keylen, hash)) != NULL)
+    drop_cold(tp, sp);
+  retry_stranded(tp);
+  if(cput(thot(tp), np, key, keylen, charge(np)) != 0) {
+    free(np);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * tiget -- a cold hit is promoted; if the hot tier cannot take it, it
+ * is appended to the log again. A stranded node is served where it is
+ */
+int32_t tiget(tier_t *tp, const char *key, int32_t keylen,
+	      void *buf, int32_t bufsize) {
+  tnode_t *np;
+  slot_t *sp;
+  record_t *rp;
+  tkey_t k = { key, keylen };
+  uint32_t hash;
+  int32_t vallen;
+
+  np = (tnode_t*)cget(thot(tp), key, keylen);
+  if(np != NULL) {
+    memcpy(buf, np->data + keylen, np->vallen < bufsize ? np->vallen : bufsize);
+    return np->vallen;
+  }
+  if(tnstranded(tp) > 0 &&
+     (np = (tnode_t*)qsearch(tstranded(tp), is_node, &k)) != NULL) {
+    memcpy(buf, np->data + keylen, np->vallen < bufsize ? np->vallen : bufsize);
+    return np->vallen;
+  }
+  hash = thashfn(tp, key, keylen);
+  if((sp = find_slot(tp, key, keylen, hash)) == NULL)
+    return -1;
+  rp = record_at(tp, sp->off);
+  vallen = rp->vallen;
+  memcpy(buf, rp->data + keylen, vallen < bufsize ? vallen : bufsize);
+  np = make_node(tp, key, keylen, rp->data + keylen, vallen, hash);
+  if(np == NULL)
+    return vallen;		/* stays cold */
+  drop_cold(tp, sp);
+  tpromotions(tp)++;
+  if(cput(thot(tp), np, key, keylen, charge(np)) != 0)
+    demote(np);
+  return vallen;
+}
+
+int32_t tiremove(tier_t *tp, const char *key, int32_t keylen) {
+  tnode_t *np;
+  slot_t *sp;
+
+  if((np = (tnode_t*)cremove(thot(tp), key, keylen)) != NULL ||
+     (np = unstrand(tp, key, keylen)) != NULL) {
+    free(np);
+    return 0;
+  }
+  if((sp = find_slot(tp, key, keylen, thashfn(tp, key, keylen))) != NULL) {
+    drop_cold(tp, sp);
+    return 0;
+  }
+  return -1;
+}
+
+uint64_t ticompact(tier_t *tp, uint64_t budget) {
+  return compact(tp, budget);
+}
+
+void tistats(tier_t *tp, tistats_t *sp) {
+  cstats(thot(tp), &sp->hot, &sp->hotbytes, NULL, NULL);
+  sp->hot += tnstranded(tp);
+  sp->hotbytes += tstrandedbytes(tp);
+  sp->stranded = tnstranded(tp);
+  sp->cold = tcold(tp);
+  sp->filebytes = ttop(tp) - LOG_START;
+  sp->deadbytes = tdeadbytes(tp);
+  sp->demotions = tdemotions(tp);
+  sp->promotions = tpromotions(tp);
+  sp->lost = tlost(tp);
+}
+
+/* END OF PUBLIC SECTION */
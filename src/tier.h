@@ -0,0 +1,74 @@
+#pragma once
+/*
+ * tier.h -- A two-tier table of values stored under arbitrary keys: a
+ * hot tier in memory, bounded in bytes, and a cold tier in a local
+ * file. Entries the hot tier evicts, least recently used first, are
+ * demoted to the file; cold entries found by tiget are promoted back.
+ * Built from the cache module. Keys and values are copied, as cold
+ * ones live on disk.
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void tier_t;		/* representation of a table hidden */
+
+/* statistics of a tiered table */
+typedef struct {
+  uint64_t hot;			/* entries in memory */
+  uint64_t hotbytes;		/* and the bytes they are charged */
+  uint64_t cold;		/* entries in the file */
+  uint64_t filebytes;		/* of the file in use, live or not */
+  uint64_t deadbytes;		/* of which removed, to be compacted */
+  uint64_t demotions;		/* entries moved from memory to file */
+  uint64_t promotions;		/* and back */
+  uint64_t stranded;		/* of hot, kept over the limit as the
+				   file could not take them (disk full) */
+  uint64_t lost;		/* demotions that failed with no memory
+				   to keep the entry either */
+} tistats_t;
+
+/* tiopen -- opens a tiered table with hsize hash buckets, keeping at
+ * most maxbytes bytes of entries in memory; the cold tier is an
+ * append-only file at path with its index in path.idx, both scratch
+ * space: created empty and unlinked at once, so they go when the
+ * table is closed or the process ends
+ * returns NULL if unsuccessful
+ */
+tier_t *tiopen(const char *path, uint32_t hsize, uint64_t maxbytes);
+
+/* ticlose -- closes a tiered table, freeing its files' space */
+void ticlose(tier_t *tp);
+
+/* tiput -- puts a copy of the value under a copy of the key in the
+ * hot tier, replacing any value in either tier, and demotes entries
+ * until the hot tier is within its limit; an entry the file cannot
+ * take (the disk is full) stays in memory, over the limit, and is
+ * demoted by a later put once there is room
+ * returns 0 for success; non-zero otherwise
+ */
+int32_t tiput(tier_t *tp, const char *key, int32_t keylen,
+	      const void *val, int32_t vallen);
+
+/* tiget -- copies the value under key into buf, truncated to bufsize
+ * bytes, promoting it if it was cold -- returns the length of the
+ * whole value, or -1 if there is none
+ */
+int32_t tiget(tier_t *tp, const char *key, int32_t keylen,
+	      void *buf, int32_t bufsize);
+
+/* tiremove -- removes the value under key from whichever tier has it
+ * returns 0 for success; non-zero if there was none
+ */
+int32_t tiremove(tier_t *tp, const char *key, int32_t keylen);
+
+/* ticompact -- reclaims the file space of removed and promoted
+ * entries by sliding live ones down, budget bytes of the file at a
+ * time (0 means to the end); demotions also do a step whenever dead
+ * bytes outweigh live ones -- returns the bytes of file still to
+ * pass over, 0 once done
+ */
+uint64_t ticompact(tier_t *tp, uint64_t budget);
+
+/* tistats -- reports the statistics of a tiered table */
+void tistats(tier_t *tp, tistats_t *sp);
@@ -0,0 +1,198 @@
+/*
+ * trace.c -- implements latency tracing: per-thread log-linear
+ * histograms of sampled operation latencies.
+ *
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <trace.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define SUBBITS 3		/* 8 linear steps per power of 2 */
+#define NBUCKETS (64 << SUBBITS)
+
+
+/* PRIVATE SECTION */
+
+/*
+ * A latency v is counted in bucket v if v < 8; otherwise its top bit
+ * e and the SUBBITS bits below it choose the bucket, so each bucket
+ * spans 1/8 of a power of 2. Each thread counts into its own
+ * histogram, linked into a list on its first record so dumps can find
+ * it; a histogram outlives its thread. Counts are only written by
+ * their own thread but read by any, so they are atomic: relaxed loads
+ * and stores, which compile to plain moves, rather than a locked
+ * increment.
+ */
+typedef struct thist_struct {
+  _Atomic uint64_t count[TR_NOPS][NBUCKETS];
+  struct thist_struct *nextp;
+} thist_t;
+
+static const char *op_names[TR_NOPS] = {
+  "qput", "qget", "qsearch", "hput", "hsearch", "hremove"
+};
+
+typedef void (*trace_fn_t)(trace_op_t op, uint64_t cycles);
+
+static _Atomic trace_fn_t callback;
+static thist_t *hists;		/* every thread's histogram */
+static pthread_mutex_t hists_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local thist_t *mine; /* this thread's histogram */
+
+static int bucket_of(uint64_t v) {
+  int e;
+
+  if(v < (1 << SUBBITS))
+    return (int)v;
+  e = 63 - __builtin_clzll(v);
+  return ((e - SUBBITS + 1) << SUBBITS) +
+    (int)((v >> (e - SUBBITS)) & ((1 << SUBBITS) - 1));
+}
+
+/* the smallest latency counted in bucket b */
+static uint64_t bucket_floor(int b) {
+  int e;
+
+  if(b < (1 << SUBBITS))
+    return (uint64_t)b;
+  e = (b >> SUBBITS) + SUBBITS - 1;
+  return ((uint64_t)1 << e) |
+    ((uint64_t)(b & ((1 << SUBBITS) - 1)) << (e - SUBBITS));
+}
+
+/* sum the histograms of op over all threads into counts */
+static uint64_t gather(trace_op_t op, uint64_t counts[NBUCKETS]) {
+  thist_t *hp;
+  uint64_t total, n;
+  int b;
+
+  memset(counts, 0, sizeof(uint64_t)*NBUCKETS);
+  total = 0;
+  pthread_mutex_lock(&hists_lock);
+  for(hp=hists; hp!=NULL; hp=hp->nextp)
+    for(b=0; b<NBUCKETS; b++) {
+      n = atomic_load_explicit(&hp->count[op][b], memory_order_relaxed);
+      counts[b] += n;
+      total += n;
+    }
+  pthread_mutex_unlock(&hists_lock);
+  return total;
+}
+/* END OF PRIVATE SECTION */
+
+
+
+/* PUBLIC SECTION */
+
+_Atomic uint32_t trace_every;
+_Thread_local uint32_t trace_countdown[TR_NOPS];
+
+uint64_t trace_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void trace_record(trace_op_t op, uint64_t cycles) {
+  _Atomic uint64_t *cp;
+  trace_fn_t fn;
+
+  if(mine == NULL) {
+    mine = calloc(1, sizeof(thist_t));
+    if(mine == NULL)
+      return;
+    pthread_mutex_lock(&hists_lock);
+    mine->nextp = hists;
+    hists = mine;
+    pthread_mutex_unlock(&hists_lock);
+  }
+  cp = &mine->count[op][bucket_of(cycles)];
+  atomic_store_explicit(cp, atomic_load_explicit(cp, memory_order_relaxed) + 1,
+			memory_order_relaxed);
+  if((fn = atomic_load_explicit(&callback, memory_order_relaxed)) != NULL)
+    (*fn)(op, cycles);
+}
+
+void tsetsampling(uint32_t every) {
+  atomic_store_explicit(&trace_every, every, memory_order_relaxed);
+}
+
+void tsetcallback(void (*fn)(trace_op_t op, uint64_t cycles)) {
+  atomic_store_explicit(&callback, fn, memory_order_relaxed);
+}
+
+uint64_t tpercentile(trace_op_t op, double p) {
+  uint64_t counts[NBUCKETS], total, seen, rank;
+  int b;
+
+  total = gather(op, counts);
+  if(total == 0)
+    return 0;
+  rank = (uint64_t)(p*total);
+  if(rank >= total)
+    rank = total - 1;
+  for(seen=0, b=0; b<NBUCKETS-1; b++) {
+    seen += counts[b];
+    if(seen > rank)
+      break;
+  }
+  return bucket_floor(b);
+}
+
+uint64_t tcount(trace_op_t op) {
+  uint64_t counts[NBUCKETS];
+
+  return gather(op, counts);
+}
+
+/*
+ * tdump -- counts from threads still running may be a little stale,
+ * as histograms are read without stopping them
+ */
+void tdump(FILE *fp) {
+  int op;
+
+#ifndef TRACE
+  fprintf(fp, "[tracing not compiled in -- build with -DTRACE]\n");
+#endif
+  fprintf(fp, "%-8s %12s %10s %10s %10s %10s %10s\n", "op", "count",
+	  "p50", "p90", "p99", "p99.9", "max");
+  for(op=0; op<TR_NOPS; op++)
+    if(tcount(op) > 0)
+      fprintf(fp, "%-8s %12lu %10lu %10lu %10lu %10lu %10lu\n",
+	      op_names[op], (unsigned long)tcount(op),
+	      (unsigned long)tpercentile(op, 0.5),
+	      (unsigned long)tpercentile(op, 0.9),
+	      (unsigned long)tpercentile(op, 0.99),
+	      (unsigned long)tpercentile(op, 0.999),
+	      (unsigned long)tpercentile(op, 1.0));
+}
+
+void treset(void) {
+  thist_t *hp;
+  int op, b;
+
+  pthread_mutex_lock(&hists_lock);
+  for(hp=hists; hp!=NULL; hp=hp->nextp)
+    for(op=0; op<TR_NOPS; op++)
+      for(b=0; b<NBUCKETS; b++)
+	atomic_store_explicit(&hp->count[op][b], 0, memory_order_relaxed);
+  pthread_mutex_unlock(&hists_lock);
+}
+
+/* END OF PUBLIC SECTION */
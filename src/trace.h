@@ -0,0 +1,87 @@
+#pragma once
+/*
+ * trace.h -- optional latency tracing of queue and hash operations.
+ *
+ * Probes are compiled in only when the library is built with -DTRACE
+ * (e.g. make XFLAGS="-g -DTRACE"); otherwise they expand to nothing
+ * and the functions below do nothing. Once tracing is compiled in,
+ * tsetsampling chooses how many operations are timed: a timed
+ * operation's latency, in cycles, is counted in a log-linear
+ * histogram belonging to the calling thread, and passed to the
+ * callback if one is set.
+ *
+ * make bench measures what the probes cost (btrace without them,
+ * btraced with): compiled in, they add about a nanosecond to each
+ * operation, and sampling one in 1000 adds too little to tell from
+ * run-to-run noise; timing every operation adds two clock reads.
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+/* the operations traced */
+typedef enum {
+  TR_QPUT, TR_QGET, TR_QSEARCH, TR_HPUT, TR_HSEARCH, TR_HREMOVE,
+  TR_NOPS
+} trace_op_t;
+
+/* tsetsampling -- time one in every `every` operations of each kind
+ * made by each thread; 0 (the default) times none, 1 times all
+ */
+void tsetsampling(uint32_t every);
+
+/* tsetcallback -- calls fn with every latency recorded, from the
+ * thread that made the operation; NULL removes it
+ */
+void tsetcallback(void (*fn)(trace_op_t op, uint64_t cycles));
+
+/* tpercentile -- the latency, in cycles, below which fraction p (0 to
+ * 1) of the recorded latencies of op lie, over all threads; to within
+ * 1/8 of its value. 0 if none are recorded
+ */
+uint64_t tpercentile(trace_op_t op, double p);
+
+/* tcount -- the number of latencies of op recorded, over all threads */
+uint64_t tcount(trace_op_t op);
+
+/* tdump -- prints the count and percentiles of each operation */
+void tdump(FILE *fp);
+
+/* treset -- forgets all recorded latencies */
+void treset(void);
+
+#ifdef TRACE
+#include <stdatomic.h>
+
+/* what the probes need, inlined to keep untimed operations cheap; the
+ * sampling rate is shared by all threads, so it is read atomically
+ * (relaxed, which costs no more than a plain load)
+ */
+extern _Atomic uint32_t trace_every;
+extern _Thread_local uint32_t trace_countdown[TR_NOPS];
+uint64_t trace_clock(void);
+void trace_record(trace_op_t op, uint64_t cycles);
+
+static inline uint64_t trace_begin(trace_op_t op) {
+  uint32_t every = atomic_load_explicit(&trace_every, memory_order_relaxed);
+
+  if(every == 0 || --trace_countdown[op] < every)
+    return 0;
+  trace_countdown[op] = every - 1;
+  return trace_clock();
+}
+
+static inline void trace_end(trace_op_t op, uint64_t start) {
+  if(start != 0)
+    trace_record(op, trace_clock() - start);
+}
+
+/* TRACE_BEGIN(op,t) starts timing op into a new variable t, if it is
+ * sampled; TRACE_END(op,t) records the time since as a latency of op
+ */
+#define TRACE_BEGIN(op,t) uint64_t t = trace_begin(op)
+#define TRACE_END(op,t) trace_end(op, t)
+#else
+#define TRACE_BEGIN(op,t)
+#define TRACE_END(op,t)
+#endif
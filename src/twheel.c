@@ -0,0 +1,303 @@
+/*
+ * twheel.c -- implements a hierarchical timing wheel: LEVELS wheels of
+ * SLOTS queues, each slot of level L spanning SLOTS^L ticks.
+ *
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <queue.h>
+#include <hash.h>
+#include <twheel.h>
+
+#define SLOTBITS 8		/* a tick's digits are bytes */
+#define SLOTS (1 << SLOTBITS)	/* slots in each level */
+#define LEVELS 8		/* 8 levels of bytes cover any uint64_t */
+
+
+/* PRIVATE SECTION */
+
+/*
+ * A timer due at tick e is kept at the level of the highest digit in
+ * which e differs from the next tick to be run, in the slot given by
+ * that digit of e (level 0 if e is the next tick itself). When the
+ * clock reaches the start of the range a slot of level L > 0 spans,
+ * its timers cascade down to lower levels, moved with qtransfer so
+ * their handles stay valid; a slot of level 0 holds timers due on
+ * exactly one tick.
+ */
+typedef struct {
+  void *elementp;		/* the element to expire */
+  uint64_t expires;		/* tick it is due on */
+  queue_t *slot;		/* queue it is in */
+  int level;			/* and that queue's level */
+  qhandle_t *qh;		/* its position there */
+  hashtable_t *table;		/* for twhput entries; else NULL */
+  int32_t keylen;		/* and the entry's key */
+  char key[];
+} twnode_t;
+
+/* the hidden structure of a wheel */
+typedef struct {
+  queue_t *slots[LEVELS][SLOTS];
+  uint64_t now;			/* the clock */
+  uint64_t next;		/* next tick to run; all before are done */
+  bool cascaded;		/* next's cascade is done, its expiry not */
+  uint64_t pending;		/* timers scheduled */
+  uint64_t count[LEVELS];	/* of which at each level */
+  void (*expirefn)(void *ep);	/* releases expired elements */
+} hwheel_t;
+
+/* accessor macros */
+#define wslot(wp,l,s) (((hwheel_t*)wp)->slots[l][s])
+#define wnow(wp) (((hwheel_t*)wp)->now)
+#define wnext(wp) (((hwheel_t*)wp)->next)
+#define wcascaded(wp) (((hwheel_t*)wp)->cascaded)
+#define wpending(wp) (((hwheel_t*)wp)->pending)
+#define wcount(wp) (((hwheel_t*)wp)->count)
+#define wexpirefn(wp) (((hwheel_t*)wp)->expirefn)
+
+#define digit(t,l) (((t) >> ((l)*SLOTBITS)) & (SLOTS-1))
+
+/*
+ * hidden helper functions
+ */
+
+/* choose the level and slot of timer np */
+static void place(hwheel_t *wp, twnode_t *np) {
+  uint64_t diff;
+  int l;
+
+  diff = np->expires ^ wnext(wp);
+  for(l=0; l<LEVELS-1 && (diff >> ((l+1)*SLOTBITS)) != 0; l++)
+    ;
+  np->level = l;
+  np->slot = wslot(wp, l, digit(np->expires, l));
+  wcount(wp)[l]++;
+}
+
+/* take timer np, still in its slot, out of the wheel */
+static void unlink_timer(hwheel_t *wp, twnode_t *np) {
+  qremove_handle(np->slot, np->qh);
+  wcount(wp)[np->level]--;
+  wpending(wp)--;
+}
+
+/*
+ * skip -- the first tick from wnext on that may need work: with
+ * levels below L empty, nothing happens until the next multiple of
+ * SLOTS^L, where level L may cascade
+ */
+static uint64_t skip(hwheel_t *wp) {
+  uint64_t t, span;
+  int l;
+
+  if(wpending(wp) == 0)
+    return wnow(wp) + 1;
+  for(l=0; wcount(wp)[l] == 0; l++)
+    ;
+  t = wnext(wp);
+  if(l == 0)
+    return t;
+  span = (uint64_t)1 << (l*SLOTBITS);
+  if((t & (span-1)) == 0)
+    return t;
+  t = (t | (span-1)) + 1;
+  return (t == 0 || t > wnow(wp)) ? wnow(wp) + 1 : t;
+}
+
+/* move the timers of every slot whose range starts at tick t down */
+static void cascade(hwheel_t *wp, uint64_t t) {
+  twnode_t *np;
+  queue_t *qp;
+  int l;
+
+  for(l=1; l<LEVELS && digit(t, l-1) == 0; l++) {
+    qp = wslot(wp, l, digit(t, l));
+    while((np = (twnode_t*)qpeek(qp)) != NULL) {
+      wcount(wp)[l]--;
+      place(wp, np);
+      qtransfer(np->slot, qp);
+    }
+  }
+}
+
+/* search function matching an entry by identity */
+static bool is_element(void *ep, const void *searchkeyp) {
+  return ep == searchkeyp;
+}
+
+/* take the entry of timer np, if any, out of its table */
+static bool remove_entry(twnode_t *np) {
+  if(np->table == NULL)
+    return true;
+  return hremove_h(np->table, is_element, (const char*)np->elementp,
+		   hhash(np->table, np->key, np->keylen)) != NULL;
+}
+
+/* expire the timer np, now out of its queue */
+static void expire(hwheel_t *wp, twnode_t *np) {
+  void *ep;
+  bool found;
+
+  ep = np->elementp;
+  found = remove_entry(np);
+  free(np);
+  if(!found)			/* already gone from the table */
+    return;
+  if(wexpirefn(wp) != NULL)
+    (*wexpirefn(wp))(ep);
+  else
+    free(ep);
+}
+
+static twtimer_t *schedule(hwheel_t *wp, twnode_t *np, uint64_t delay) {
+  if(delay == 0)
+    delay = 1;
+  np->expires = wnow(wp) + delay;
+  place(wp, np);
+  np->qh = qput_handle(np->slot, np);
+  if(np->qh == NULL) {
+    wcount(wp)[np->level]--;
+    free(np);
+    return NULL;
+  }
+  wpending(wp)++;
+  return (twtimer_t*)np;
+}
+/* END OF PRIVATE SECTION */
+
+
+
+/* PUBLIC SECTION */
+
+twheel_t *twopen(void (*expirefn)(void *ep)) {
+  hwheel_t *wp;
+  int l, s;
+
+  wp = calloc(1, sizeof(hwheel_t));
+  if(wp == NULL)
+    return NULL;
+  for(l=0; l<LEVELS; l++)
+    for(s=0; s<SLOTS; s++)
+      if((wslot(wp, l, s) = qopen()) == NULL) {
+	twclose(wp);
+	return NULL;
+      }
+  wnow(wp) = 0;
+  wnext(wp) = 1;		/* nothing is due at 0 */
+  wcascaded(wp) = false;
+  wpending(wp) = 0;
+  wexpirefn(wp) = expirefn;
+  return (twheel_t*)wp;
+}
+
+/*
+ * twclose -- the nodes are the queues' elements, so qclose frees them
+ */
+void twclose(twheel_t *wp) {
+  int l, s;
+
+  for(l=0; l<LEVELS; l++)
+    for(s=0; s<SLOTS; s++)
+      if(wslot(wp, l, s) != NULL)
+	qclose(wslot(wp, l, s));
+  free(wp);
+}
+
+twtimer_t *twput(twheel_t *wp, void *ep, uint64_t delay) {
+  twnode_t *np;
+
+  np = malloc(sizeof(twnode_t));
+  if(np == NULL)
+    return NULL;
+  np->elementp = ep;
+  np->table = NULL;
+  np->keylen = 0;
+  return schedule(wp, np, delay);
+}
+
+void *twcancel(twheel_t *wp, twtimer_t *tp) {
+  twnode_t *np = (twnode_t*)tp;
+  void *ep;
+
+  unlink_timer(wp, np);
+  ep = np->elementp;
+  free(np);
+  return ep;
+}
+
+twtimer_t *twhput(twheel_t *wp, hashtable_t *htp, void *ep,
+		  const char *key, int32_t keylen, uint64_t ttl) {
+  twnode_t *np;
+  twtimer_t *tp;
+
+  np = malloc(sizeof(twnode_t) + keylen);
+  if(np == NULL)
+    return NULL;
+  np->elementp = ep;
+  np->table = htp;
+  np->keylen = keylen;
+  memcpy(np->key, key, keylen);
+  tp = schedule(wp, np, ttl);	/* (frees np on failure) */
+  if(tp != NULL && hput(htp, ep, key, keylen) != 0) {
+    twcancel(wp, tp);
+    return NULL;
+  }
+  return tp;
+}
+
+void *twhremove(twheel_t *wp, twtimer_t *tp) {
+  bool found;
+  void *ep;
+
+  found = remove_entry((twnode_t*)tp);
+  ep = twcancel(wp, tp);
+  return found ? ep : NULL;
+}
+
+/*
+ * twadvance -- runs ticks in order up to the clock, skipping those
+ * with nothing to do: first a tick's cascade, then its expiries, one
+ * at a time from the front of its level 0 slot so the expire function
+ * may put or cancel other timers
+ */
+uint64_t twadvance(twheel_t *wp, uint64_t ticks, uint64_t budget) {
+  twnode_t *np;
+  queue_t *qp;
+  uint64_t expired;
+
+  wnow(wp) += ticks;
+  expired = 0;
+  while(wnext(wp) <= wnow(wp)) {
+    if(!wcascaded(wp)) {
+      wnext(wp) = skip(wp);
+      if(wnext(wp) > wnow(wp))
+	break;
+      cascade(wp, wnext(wp));
+      wcascaded(wp) = true;
+    }
+    qp = wslot(wp, 0, digit(wnext(wp), 0));
+    while((np = (twnode_t*)qpeek(qp)) != NULL) {
+      if(budget != 0 && expired == budget)
+	return expired;		/* the rest of this tick next time */
+      unlink_timer(wp, np);
+      expire(wp, np);
+      expired++;
+    }
+    wnext(wp)++;
+    wcascaded(wp) = false;
+  }
+  return expired;
+}
+
+uint64_t twnow(twheel_t *wp) {
+  return wnow(wp);
+}
+
+uint64_t twpending(twheel_t *wp) {
+  return wpending(wp);
+}
+
+/* END OF PUBLIC SECTION */
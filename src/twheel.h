@@ -0,0 +1,67 @@
+#pragma once
+/*
+ * twheel.h -- A hierarchical timing wheel: elements scheduled to
+ * expire after a number of ticks, built from the queue module.
+ * Scheduling and cancelling are O(1); advancing is O(1) amortized per
+ * tick and per expiry. Entries of a hash table can be given a time to
+ * live, after which they are removed from the table and released.
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <hash.h>
+
+typedef void twheel_t;		/* representation of a wheel hidden */
+typedef void twtimer_t;		/* a scheduled element, also hidden */
+
+/* twopen -- opens a wheel at tick 0; expirefn is called on each
+ * element as it expires -- if expirefn is NULL such elements are
+ * free'd
+ */
+twheel_t *twopen(void (*expirefn)(void *ep));
+
+/* twclose -- closes a wheel, dropping the timers still pending
+ * without expiring their elements
+ */
+void twclose(twheel_t *wp);
+
+/* twput -- schedules element ep to expire delay ticks from now (a
+ * delay of 0 is taken as 1) -- returns a timer for twcancel, valid
+ * until the element expires or is cancelled, or NULL on failure
+ */
+twtimer_t *twput(twheel_t *wp, void *ep, uint64_t delay);
+
+/* twcancel -- cancels a pending timer in O(1), returning its element */
+void *twcancel(twheel_t *wp, twtimer_t *tp);
+
+/* twhput -- puts ep into table htp under key (as hput) and schedules
+ * its removal ttl ticks from now: on expiry the entry is removed from
+ * the table and passed to the expire function. The timer knows its
+ * entry only by key and address, so an entry must leave the table
+ * early through twhremove (or have its timer cancelled first): were
+ * it removed and free'd behind the timer's back, and another element
+ * put under the same key at the same address, the old timer would
+ * expire the new entry
+ * returns a timer as twput, or NULL on failure (with ep not put)
+ */
+twtimer_t *twhput(twheel_t *wp, hashtable_t *htp, void *ep,
+		  const char *key, int32_t keylen, uint64_t ttl);
+
+/* twhremove -- removes the entry of a pending twhput timer from its
+ * table and cancels the timer, in one step -- returns the entry, or
+ * NULL if it was no longer in the table
+ */
+void *twhremove(twheel_t *wp, twtimer_t *tp);
+
+/* twadvance -- moves the wheel's clock ticks ticks on, expiring every
+ * element that falls due, but at most budget of them (0 means no
+ * limit); elements left over expire first on the next call
+ * returns the number of elements expired
+ */
+uint64_t twadvance(twheel_t *wp, uint64_t ticks, uint64_t budget);
+
+/* twnow -- the wheel's clock, in ticks since it was opened */
+uint64_t twnow(twheel_t *wp);
+
+/* twpending -- the number of timers not yet expired or cancelled */
+uint64_t twpending(twheel_t *wp);
@@ -0,0 +1,70 @@
+/*
+ * bcache.c -- hit-rate and latency benchmark for the cache module
+ *
+ * A skewed (hot set) workload is interleaved with a one-pass scan of
+ * cold keys; the scan pollutes an LRU cache but not a CLOCK cache.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <cache.h>
+
+#define KEYSPACE 100000		/* distinct hot keys */
+#define CAPACITY 10000		/* cache entries */
+#define SCANEVERY 4		/* one scan key per this many accesses */
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec*1e9 + (double)ts.tv_nsec;
+}
+
+/* a key from the hot set, skewed towards small values */
+static uint64_t hot_key(void) {
+  double x = (double)rand()/RAND_MAX;
+  return (uint64_t)(KEYSPACE*x*x*x);
+}
+
+static void run(const char *name, int policy, long accesses) {
+  cache_t *cp;
+  uint64_t key, scankey, hits, misses;
+  uint64_t *ep;
+  double start, elapsed;
+  long i;
+
+  srand(1);
+  cp = copen(CAPACITY, policy, CAPACITY, 0, NULL);
+  scankey = KEYSPACE;		/* scan keys are never reused */
+  start = now_ns();
+  for(i=0; i<accesses; i++) {
+    if(i % SCANEVERY == 0)
+      key = scankey++;
+    else
+      key = hot_key();
+    if(cget(cp, (char*)&key, sizeof(key)) == NULL) {
+      ep = malloc(sizeof(uint64_t));
+      *ep = key;
+      cput(cp, ep, (char*)&key, sizeof(key), sizeof(uint64_t));
+    }
+  }
+  elapsed = now_ns() - start;
+  cstats(cp, NULL, NULL, &hits, &misses);
+  printf("%-6s hit rate %5.1f%%  %6.1f ns/access\n", name,
+	 100.0*hits/(hits+misses), elapsed/accesses);
+  cclose(cp);
+}
+
+int main(int argc, char *argv[]) {
+  long accesses;
+
+  if(argc!=2 || (accesses=atol(argv[1]))<=0) {
+    printf("[Usage: bcache <accesses>]\n");
+    exit(EXIT_FAILURE);
+  }
+  run("LRU", CACHE_LRU, accesses);
+  run("CLOCK", CACHE_CLOCK, accesses);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,259 @@
+/*
+ * bconc.c -- contention and tail-latency benchmark for the queue and
+ * hash modules: threads, each pinned to a CPU, share one queue or one
+ * table, guarded by a lock as the modules are not thread-safe
+ *
+ * Closed-loop runs issue operations back to back, reporting how
+ * throughput scales as threads are added. An open-loop run issues
+ * each thread's operations on a fixed schedule and times each from
+ * when it was due rather than when it started, so a stall is charged
+ * to every operation held up behind it (correcting for coordinated
+ * omission); the uncorrected p99 is shown alongside for contrast.
+ */
+#define _GNU_SOURCE		/* for pthread_setaffinity_np */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <queue.h>
+#include <hash.h>
+
+#define NKEYS 100000		/* keys in the shared table */
+#define MAXTHREADS 256
+
+enum { W_QUEUE, W_HASH };	/* workloads */
+
+/* one thread's run */
+typedef struct {
+  int id;
+  int nthreads;
+  int workload;
+  long ops;
+  double interval;		/* ns between operations; 0 for closed loop */
+  uint64_t *latency;		/* of each operation, from when it was due */
+  uint64_t *service;		/* and from when it started */
+  uint64_t elapsed;
+} worker_t;
+
+static queue_t *queue;
+static hashtable_t *table;
+static pthread_mutex_t qlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t hlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t barrier;
+static int readpct = 90;	/* of hash operations that are searches */
+static int token;		/* the element producers put */
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static bool is_key(void *ep, const void *keyp) {
+  return *(uint64_t*)ep == *(const uint64_t*)keyp;
+}
+
+static uint64_t next_rand(uint64_t *statep) {
+  *statep = *statep*6364136223846793005ULL + 1442695040888963407ULL;
+  return *statep >> 17;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/* run each thread on its own CPU where there are enough */
+static void pin(int id) {
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(id % sysconf(_SC_NPROCESSORS_ONLN), &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+ * do_op -- queue threads alternate as producers and consumers (a lone
+ * thread does both in turn); hash writes remove a key and put it back,
+ * so the table keeps its size
+ */
+static void do_op(worker_t *wp, long i, uint64_t *statep) {
+  uint64_t key;
+  void *ep;
+  bool producer;
+
+  if(wp->workload == W_QUEUE) {
+    producer = (wp->nthreads == 1) ? (i % 2 == 0) : (wp->id % 2 == 0);
+    pthread_mutex_lock(&qlock);
+    if(producer)
+      qput(queue, &token);
+    else
+      qget(queue);
+    pthread_mutex_unlock(&qlock);
+    return;
+  }
+  key = next_rand(statep) % NKEYS;
+  pthread_mutex_lock(&hlock);
+  if((int)(next_rand(statep) % 100) < readpct) {
+    if(hsearch(table, is_key, (char*)&key, sizeof(key)) == NULL)
+      exit(EXIT_FAILURE);
+  }
+  else if((ep = hremove(table, is_key, (char*)&key, sizeof(key))) != NULL)
+    hput(table, ep, (char*)ep, sizeof(uint64_t));
+  pthread_mutex_unlock(&hlock);
+}
+
+static void *worker(void *arg) {
+  worker_t *wp = (worker_t*)arg;
+  uint64_t state, start, due, t;
+  long i;
+
+  pin(wp->id);
+  state = (uint64_t)wp->id + 1;
+  pthread_barrier_wait(&barrier);
+  start = now_ns();
+  for(i=0; i<wp->ops; i++) {
+    t = now_ns();
+    due = t;
+    if(wp->interval > 0) {
+      due = start + (uint64_t)(i*wp->interval);
+      while(t < due)		/* wait for its turn, if it is not late */
+	t = now_ns();
+    }
+    do_op(wp, i, &state);
+    wp->latency[i] = now_ns() - due;
+    wp->service[i] = wp->latency[i] - (t - due);
+  }
+  wp->elapsed = now_ns() - start;
+  return NULL;
+}
+
+static void setup(int workload) {
+  uint64_t *ep, i;
+
+  if(workload == W_QUEUE) {
+    if((queue = qopen()) == NULL)
+      exit(EXIT_FAILURE);
+    return;
+  }
+  if((table = hopen(NKEYS)) == NULL)
+    exit(EXIT_FAILURE);
+  for(i=0; i<NKEYS; i++) {
+    if((ep = malloc(sizeof(uint64_t))) == NULL)
+      exit(EXIT_FAILURE);
+    *ep = i;
+    if(hput(table, ep, (char*)ep, sizeof(uint64_t)) != 0)
+      exit(EXIT_FAILURE);
+  }
+}
+
+static void teardown(int workload) {
+  if(workload == W_QUEUE) {
+    while(qget(queue) != NULL)	/* the token is not to be free'd */
+      ;
+    qclose(queue);
+  }
+  else
+    hclose(table);
+}
+
+/* the p'th percentile of n sorted values */
+static uint64_t percentile(uint64_t *v, uint64_t n, double p) {
+  return v[(uint64_t)(p*(n-1))];
+}
+
+/* run nthreads threads of ops operations each, at rate ops/s each
+ * (0 for closed loop), and report
+ */
+static void run(int workload, int nthreads, long ops, double rate) {
+  pthread_t tids[MAXTHREADS];
+  worker_t workers[MAXTHREADS];
+  uint64_t *latency, *service, n, elapsed;
+  char name[32];
+  int t;
+
+  n = (uint64_t)nthreads*ops;
+  latency = malloc(n*sizeof(uint64_t));
+  service = malloc(n*sizeof(uint64_t));
+  if(latency == NULL || service == NULL) {
+    printf("[Error: out of memory]\n");
+    exit(EXIT_FAILURE);
+  }
+  setup(workload);
+  pthread_barrier_init(&barrier, NULL, nthreads);
+  for(t=0; t<nthreads; t++) {
+    workers[t].id = t;
+    workers[t].nthreads = nthreads;
+    workers[t].workload = workload;
+    workers[t].ops = ops;
+    workers[t].interval = rate > 0 ? 1e9/rate : 0;
+    workers[t].latency = latency + t*ops;
+    workers[t].service = service + t*ops;
+    if(pthread_create(&tids[t], NULL, worker, &workers[t]) != 0)
+      exit(EXIT_FAILURE);
+  }
+  elapsed = 0;
+  for(t=0; t<nthreads; t++) {
+    pthread_join(tids[t], NULL);
+    if(workers[t].elapsed > elapsed)
+      elapsed = workers[t].elapsed;
+  }
+  pthread_barrier_destroy(&barrier);
+  teardown(workload);
+  qsort(latency, n, sizeof(uint64_t), cmp_u64);
+  qsort(service, n, sizeof(uint64_t), cmp_u64);
+  if(workload == W_QUEUE)
+    snprintf(name, sizeof(name), "queue");
+  else
+    snprintf(name, sizeof(name), "hash %d%% read", readpct);
+  printf("%-14s %7d %9.2f %9lu %9lu %9lu", name, nthreads,
+	 n*1e3/elapsed, (unsigned long)percentile(latency, n, 0.5),
+	 (unsigned long)percentile(latency, n, 0.99),
+	 (unsigned long)percentile(latency, n, 0.999));
+  if(rate > 0)
+    printf(" %12lu", (unsigned long)percentile(service, n, 0.99));
+  printf("\n");
+  free(latency);
+  free(service);
+}
+
+int main(int argc, char *argv[]) {
+  long ops;
+  double rate;
+  int maxthreads, nthreads, workload;
+
+  rate = 0;
+  if(argc<3 || argc>5 || (maxthreads=atoi(argv[1]))<=0 ||
+     maxthreads>MAXTHREADS || (ops=atol(argv[2]))<=0 ||
+     (argc>3 && ((readpct=atoi(argv[3]))<0 || readpct>100)) ||
+     (argc>4 && (rate=atof(argv[4]))<=0)) {
+    printf("[Usage: bconc <maxthreads> <ops per thread> [<read %%>"
+	   " [<open-loop ops/s per thread>]]]\n");
+    exit(EXIT_FAILURE);
+  }
+  printf("closed loop (latency in ns):\n");
+  printf("%-14s %7s %9s %9s %9s %9s\n", "workload", "threads", "Mops/s",
+	 "p50", "p99", "p99.9");
+  for(workload=W_QUEUE; workload<=W_HASH; workload++)
+    for(nthreads=1; ; nthreads*=2) {
+      if(nthreads > maxthreads)
+	nthreads = maxthreads;
+      run(workload, nthreads, ops, 0);
+      if(nthreads == maxthreads)
+	break;
+    }
+  if(rate > 0) {
+    printf("open loop at %.0f ops/s per thread (latency from when due):\n",
+	   rate);
+    printf("%-14s %7s %9s %9s %9s %9s %12s\n", "workload", "threads",
+	   "Mops/s", "p50", "p99", "p99.9", "p99 uncorr.");
+    for(workload=W_QUEUE; workload<=W_HASH; workload++)
+      run(workload, maxthreads, ops, rate);
+  }
+  exit(EXIT_SUCCESS);
+}
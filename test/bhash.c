@@ -0,0 +1,113 @@
+/*
+ * bhash.c -- lookup latency benchmark for the hash module, comparing
+ * bucket arrays on normal (4K) pages with arrays on huge (2M) pages,
+ * and with the lean chains of the lhash module
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <hash.h>
+#include <lhash.h>
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec*1e9 + (double)ts.tv_nsec;
+}
+
+static bool is_key(void *ep, const void *keyp) {
+  return *(uint64_t*)ep == *(const uint64_t*)keyp;
+}
+
+/* a simple generator, so lookups are spread over the whole table */
+static uint64_t next_key(uint64_t *statep, uint64_t n) {
+  *statep = *statep*6364136223846793005ULL + 1442695040888963407ULL;
+  return (*statep >> 17) % n;
+}
+
+static void run(const char *name, bool huge, uint64_t n, long lookups) {
+  hashtable_t *ht;
+  void **elems;
+  const char **keys;
+  int32_t *keylens;
+  uint64_t i, key, state;
+  double start, elapsed;
+  long l;
+
+  hsethugepages(huge);
+  ht = hopen(n);		/* one entry per bucket on average */
+  elems = malloc(n*sizeof(void*));
+  keys = malloc(n*sizeof(char*));
+  keylens = malloc(n*sizeof(int32_t));
+  if(ht == NULL || elems == NULL || keys == NULL || keylens == NULL) {
+    printf("[Error: out of memory]\n");
+    exit(EXIT_FAILURE);
+  }
+  for(i=0; i<n; i++) {
+    elems[i] = malloc(sizeof(uint64_t));
+    *(uint64_t*)elems[i] = i;
+    keys[i] = (const char*)elems[i];
+    keylens[i] = sizeof(uint64_t);
+  }
+  if(hbuild(ht, elems, keys, keylens, n) != 0)
+    exit(EXIT_FAILURE);
+  state = 1;
+  start = now_ns();
+  for(l=0; l<lookups; l++) {
+    key = next_key(&state, n);
+    if(hsearch(ht, is_key, (char*)&key, sizeof(key)) == NULL)
+      exit(EXIT_FAILURE);
+  }
+  elapsed = now_ns() - start;
+  printf("%-3s pages: %6.1f ns/lookup\n", name, elapsed/lookups);
+  free(elems);
+  free((void*)keys);
+  free(keylens);
+  hclose(ht);
+}
+
+/* the same lookups in a lean table */
+static void run_lean(uint64_t n, long lookups) {
+  lhashtable_t *ht;
+  uint64_t *ep, i, key, state;
+  double start, elapsed;
+  long l;
+
+  if((ht = lhopen((uint32_t)n)) == NULL)
+    exit(EXIT_FAILURE);
+  for(i=0; i<n; i++) {
+    ep = malloc(sizeof(uint64_t));
+    if(ep == NULL)
+      exit(EXIT_FAILURE);
+    *ep = i;
+    if(lhput(ht, ep, (char*)ep, sizeof(uint64_t)) != 0)
+      exit(EXIT_FAILURE);
+  }
+  state = 1;
+  start = now_ns();
+  for(l=0; l<lookups; l++) {
+    key = next_key(&state, n);
+    if(lhsearch(ht, is_key, (char*)&key, sizeof(key)) == NULL)
+      exit(EXIT_FAILURE);
+  }
+  elapsed = now_ns() - start;
+  printf("lean table: %5.1f ns/lookup\n", elapsed/lookups);
+  lhclose(ht);
+}
+
+int main(int argc, char *argv[]) {
+  long n, lookups;
+
+  if(argc!=3 || (n=atol(argv[1]))<=0 || (lookups=atol(argv[2]))<=0) {
+    printf("[Usage: bhash <tablesize> <lookups>]\n");
+    exit(EXIT_FAILURE);
+  }
+  run("4K", false, (uint64_t)n, lookups);
+  run("2M", true, (uint64_t)n, lookups);
+  run_lean((uint64_t)n, lookups);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,125 @@
+/*
+ * btrace.c -- overhead benchmark for the latency probes of trace.h:
+ * times a mix of queue and hash operations with tracing off, sampling
+ * one in 1000, one in 100 and every operation. Built twice by the
+ * bench target, without the probes (btrace) and with them (btraced),
+ * so the two sets of figures can be compared.
+ */
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <hash.h>
+#include <queue.h>
+#include <trace.h>
+
+#define SMALL 1000		/* keys in a table that stays in cache */
+#define LARGE 1000000		/* and in one that does not */
+#define RUNS 5			/* of each setting; the fastest is kept */
+#define NSETTINGS 4		/* of the sampling rate */
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec*1e9 + (double)ts.tv_nsec;
+}
+
+static bool is_key(void *ep, const void *keyp) {
+  return *(uint64_t*)ep == *(const uint64_t*)keyp;
+}
+
+static uint64_t next_key(uint64_t *statep, uint64_t n) {
+  *statep = *statep*6364136223846793005ULL + 1442695040888963407ULL;
+  return (*statep >> 17) % n;
+}
+
+static hashtable_t *fill(uint64_t n) {
+  hashtable_t *ht;
+  uint64_t *ep, i;
+
+  if((ht = hopen(n)) == NULL)
+    exit(EXIT_FAILURE);
+  for(i=0; i<n; i++) {
+    if((ep = malloc(sizeof(uint64_t))) == NULL)
+      exit(EXIT_FAILURE);
+    *ep = i;
+    if(hput(ht, ep, (char*)ep, sizeof(uint64_t)) != 0)
+      exit(EXIT_FAILURE);
+  }
+  return ht;
+}
+
+/* ns per operation of ops rounds of a search, a remove and put back,
+ * and a queue put and get -- six traced operations a round -- on a
+ * table of n keys; the fastest of RUNS
+ */
+static double run(hashtable_t *ht, uint64_t n, queue_t *qp, long ops) {
+  uint64_t key, state;
+  void *ep;
+  double start, t, best;
+  long l;
+  int r;
+
+  for(best=0, r=0; r<RUNS; r++) {
+    state = 1;
+    start = now_ns();
+    for(l=0; l<ops; l++) {
+      key = next_key(&state, n);
+      if(hsearch(ht, is_key, (char*)&key, sizeof(key)) == NULL)
+	exit(EXIT_FAILURE);
+      ep = hremove(ht, is_key, (char*)&key, sizeof(key));
+      if(hput(ht, ep, (char*)ep, sizeof(uint64_t)) != 0)
+	exit(EXIT_FAILURE);
+      qput(qp, ep);
+      qget(qp);
+    }
+    t = (now_ns() - start)/(ops*6);
+    if(r == 0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  static const uint32_t every[NSETTINGS] = { 0, 1000, 100, 1 };
+  static const char *names[NSETTINGS] = { "off", "1/1000", "1/100", "all" };
+  hashtable_t *small, *large;
+  queue_t *qp;
+  double ts[NSETTINGS], tl[NSETTINGS];
+  long ops;
+  int s;
+
+  if(argc != 2 || (ops=atol(argv[1])) <= 0) {
+    printf("[Usage: btrace <rounds>]\n");
+    exit(EXIT_FAILURE);
+  }
+  small = fill(SMALL);
+  large = fill(LARGE);
+  if((qp = qopen()) == NULL)
+    exit(EXIT_FAILURE);
+#ifdef TRACE
+  printf("probes compiled in (ns/op):\n");
+#else
+  printf("probes compiled out (ns/op):\n");
+#endif
+  printf("  %-8s %8s %7s %8s %7s\n", "sampling", "cached", "", "uncached", "");
+  for(s=0; s<NSETTINGS; s++) {	/* one table at a time, to keep */
+    tsetsampling(every[s]);	/* the small one in cache */
+    ts[s] = run(small, SMALL, qp, ops);
+  }
+  for(s=0; s<NSETTINGS; s++) {
+    tsetsampling(every[s]);
+    tl[s] = run(large, LARGE, qp, ops);
+  }
+  for(s=0; s<NSETTINGS; s++)
+    printf("  %-8s %8.2f %+6.1f%% %8.2f %+6.1f%%\n", names[s],
+	   ts[s], 100*(ts[s] - ts[0])/ts[0], tl[s], 100*(tl[s] - tl[0])/tl[0]);
+  tsetsampling(0);
+  qclose(qp);
+  hclose(small);
+  hclose(large);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,138 @@
+/*
+ * tbloom.c -- regression test for the hash module's Bloom filter:
+ * searches for absent keys should rarely reach the search function,
+ * and no present key may ever be missed as the table changes
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hash.h>
+#include <tutils.h>
+
+#define THASH_DEBUG 1
+
+#define TABLESIZE 1024		/* buckets */
+#define NKEYS 10000		/* keys the filter is sized for */
+#define MAXFP 200		/* most misses that may reach the search fn */
+
+/* search for keys lo..hi-1, all absent; returns how many searches
+ * got past the filter
+ */
+static int count_misses(hashtable_t *ht, int lo, int hi) {
+  int key,passed;
+
+  for(passed=0, key=lo; key<hi; key++) {
+    search_compares=0;
+    if(hsearch(ht,is_age_counted,(char*)&key,sizeof(key))!=NULL)
+      exit(EXIT_FAILURE);
+    if(search_compares>0)
+      passed++;
+  }
+  return passed;
+}
+
+int main(void) {
+  hashtable_t *ht,*src;
+  void *elems[NKEYS];
+  const char *keys[NKEYS];
+  int32_t keylens[NKEYS];
+  int keyv[NKEYS];
+  int key,passed;
+  char nm[NAMESIZE];
+
+  /* a filled table: absent keys are turned away by the filter */
+  ht=hopen_seed(TABLESIZE,1);	/* so hharden below rehashes */
+  hsetkeyfn(ht,age_key);
+  if(hsetbloom(ht,NKEYS)!=0)
+    exit(EXIT_FAILURE);
+  put_people(ht,0,NKEYS);
+  check_people(ht,0,NKEYS);
+  passed=count_misses(ht,NKEYS,2*NKEYS);
+#ifdef THASH_DEBUG
+  printf("[%d of %d misses passed the filter]\n",passed,NKEYS);
+#endif
+  if(passed>MAXFP)
+    exit(EXIT_FAILURE);
+
+  /* remove most keys; once removals outnumber the keys left the
+   * filter is rebuilt, forgetting the keys removed so far
+   */
+  for(key=0; key<3*NKEYS/4; key++)
+    free_person(hremove(ht,is_age,(char*)&key,sizeof(key)));
+  check_people(ht,3*NKEYS/4,NKEYS);
+  passed=count_misses(ht,0,3*NKEYS/4);
+#ifdef THASH_DEBUG
+  printf("[%d of %d removed keys passed the filter]\n",passed,3*NKEYS/4);
+#endif
+  if(passed>NKEYS/4+MAXFP)
+    exit(EXIT_FAILURE);
+  if(count_misses(ht,NKEYS,2*NKEYS)>MAXFP)
+    exit(EXIT_FAILURE);
+
+  /* outgrow the filter; it is regrown */
+  put_people(ht,NKEYS,4*NKEYS);
+  check_people(ht,3*NKEYS/4,4*NKEYS);
+  if(count_misses(ht,4*NKEYS,5*NKEYS)>MAXFP)
+    exit(EXIT_FAILURE);
+
+  /* merging a table of the same shape ORs the filters */
+  src=hopen_like(ht);
+  put_people(src,0,3*NKEYS/4);
+  if(hmerge(ht,src,age_key)!=0)
+    exit(EXIT_FAILURE);
+  check_people(ht,0,4*NKEYS);
+
+  /* merging an unfiltered table of a different size rebuilds it */
+  src=hopen(TABLESIZE/2);
+  put_people(src,4*NKEYS,5*NKEYS);
+  if(hmerge(ht,src,age_key)!=0)
+    exit(EXIT_FAILURE);
+  check_people(ht,0,5*NKEYS);
+  if(count_misses(ht,5*NKEYS,6*NKEYS)>MAXFP)
+    exit(EXIT_FAILURE);
+
+  /* hardening rehashes every key, and the filter with them */
+  if(hharden(ht)!=0)
+    exit(EXIT_FAILURE);
+  check_people(ht,0,5*NKEYS);
+  if(count_misses(ht,5*NKEYS,6*NKEYS)>MAXFP)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* a filter added to a full table needs a key function to fill it */
+  ht=hopen(TABLESIZE);
+  put_people(ht,0,NKEYS);
+  if(hsetbloom(ht,NKEYS)==0)
+    exit(EXIT_FAILURE);
+  hsetkeyfn(ht,age_key);
+  if(hsetbloom(ht,NKEYS)!=0)
+    exit(EXIT_FAILURE);
+  check_people(ht,0,NKEYS);
+  if(count_misses(ht,NKEYS,2*NKEYS)>MAXFP)
+    exit(EXIT_FAILURE);
+  if(hsetbloom(ht,0)!=0)		/* and may be removed */
+    exit(EXIT_FAILURE);
+  check_people(ht,0,NKEYS);
+  hclose(ht);
+
+  /* a bulk built table fills its filter too */
+  ht=hopen(TABLESIZE);
+  if(hsetbloom(ht,NKEYS)!=0)
+    exit(EXIT_FAILURE);
+  for(key=0; key<NKEYS; key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    elems[key]=make_person(nm,key,SALARY);
+    keyv[key]=key;
+    keys[key]=(const char*)&keyv[key];
+    keylens[key]=sizeof(int);
+  }
+  if(hbuild(ht,elems,keys,keylens,NKEYS)!=0)
+    exit(EXIT_FAILURE);
+  check_people(ht,0,NKEYS);
+  if(count_misses(ht,NKEYS,2*NKEYS)>MAXFP)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+  return(EXIT_SUCCESS);
+}
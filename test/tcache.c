@@ -0,0 +1,174 @@
+/*
+ * tcache.c -- regression test for the cache module
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cache.h>
+#include <tutils.h>
+
+static int evicted;		/* number of elements evicted */
+static int lastage;		/* age of the last person evicted */
+
+static void evict_person(void *ep) {
+  evicted++;
+  lastage=((person_t*)ep)->age;
+  free_person(ep);
+}
+
+/* put a person in the cache under their name */
+static void put_person(cache_t *cp, char *name, int age, uint64_t size) {
+  if(cput(cp,make_person(name,age,SALARY),name,strlen(name),size)!=0)
+    exit(EXIT_FAILURE);
+}
+
+static void check_get(cache_t *cp, char *name, int age) {
+  check_person(cget(cp,name,strlen(name)),name,age);
+}
+
+static void check_absent(cache_t *cp, char *name) {
+  if(cget(cp,name,strlen(name))!=NULL)
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  cache_t *cp;
+  void *ep;
+  uint64_t entries,bytes,hits,misses;
+  int test;
+
+  if(argc!=2) {
+    printf("Usage: %s <testnumber> -- testnumber=1-9\n",argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  test=atoi(argv[1]);
+  evicted=0;
+  switch(test) {
+  case 1:
+    /* open and close an empty cache */
+    if((cp=copen(10,CACHE_LRU,0,0,evict_person))==NULL)
+      exit(EXIT_FAILURE);
+    check_absent(cp,"steve");
+    /* and refuse an unknown policy */
+    if(copen(10,CACHE_CLOCK+1,0,0,evict_person)!=NULL)
+      exit(EXIT_FAILURE);
+    break;
+  case 2:
+    /* hits and misses are counted */
+    cp=copen(10,CACHE_LRU,0,0,evict_person);
+    put_person(cp,"steve",STEVE_AGE,1);
+    put_person(cp,"bill",BILL_AGE,1);
+    check_get(cp,"steve",STEVE_AGE);
+    check_get(cp,"bill",BILL_AGE);
+    check_absent(cp,"john");
+    /* keys that are prefixes of each other are distinct */
+    check_absent(cp,"stev");
+    cstats(cp,&entries,&bytes,&hits,&misses);
+    if(entries!=2 || bytes!=2 || hits!=2 || misses!=2)
+      exit(EXIT_FAILURE);
+    break;
+  case 3:
+    /* LRU eviction by number of entries */
+    cp=copen(1,CACHE_LRU,2,0,evict_person);
+    put_person(cp,"steve",STEVE_AGE,1);
+    put_person(cp,"bill",BILL_AGE,1);
+    check_get(cp,"steve",STEVE_AGE);
+    put_person(cp,"john",JOHN_AGE,1);
+    if(evicted!=1 || lastage!=BILL_AGE)
+      exit(EXIT_FAILURE);
+    check_absent(cp,"bill");
+    check_get(cp,"steve",STEVE_AGE);
+    check_get(cp,"john",JOHN_AGE);
+    break;
+  case 4:
+    /* eviction by bytes, never evicting the entry just put */
+    cp=copen(10,CACHE_LRU,0,100,evict_person);
+    put_person(cp,"steve",STEVE_AGE,40);
+    put_person(cp,"bill",BILL_AGE,40);
+    put_person(cp,"john",JOHN_AGE,40);
+    if(evicted!=1 || lastage!=STEVE_AGE)
+      exit(EXIT_FAILURE);
+    put_person(cp,"fred",FRED_AGE,500);
+    if(evicted!=3)
+      exit(EXIT_FAILURE);
+    check_get(cp,"fred",FRED_AGE);
+    cstats(cp,&entries,&bytes,NULL,NULL);
+    if(entries!=1 || bytes!=500)
+      exit(EXIT_FAILURE);
+    break;
+  case 5:
+    /* CLOCK gives referenced entries a second chance */
+    cp=copen(10,CACHE_CLOCK,3,0,evict_person);
+    put_person(cp,"steve",STEVE_AGE,1);
+    put_person(cp,"bill",BILL_AGE,1);
+    put_person(cp,"john",JOHN_AGE,1);
+    check_get(cp,"steve",STEVE_AGE);
+    put_person(cp,"fred",FRED_AGE,1);
+    if(evicted!=1 || lastage!=BILL_AGE)
+      exit(EXIT_FAILURE);
+    put_person(cp,"george",GEORGE_AGE,1);
+    if(evicted!=2 || lastage!=JOHN_AGE)
+      exit(EXIT_FAILURE);
+    check_get(cp,"steve",STEVE_AGE);
+    break;
+  case 6:
+    /* replacing an entry evicts the old element */
+    cp=copen(10,CACHE_LRU,0,0,evict_person);
+    put_person(cp,"steve",STEVE_AGE,1);
+    if(cput(cp,make_person("steve",BILL_AGE,SALARY),"steve",5,3)!=0)
+      exit(EXIT_FAILURE);
+    if(evicted!=1 || lastage!=STEVE_AGE)
+      exit(EXIT_FAILURE);
+    check_get(cp,"steve",BILL_AGE);
+    cstats(cp,&entries,&bytes,NULL,NULL);
+    if(entries!=1 || bytes!=3)
+      exit(EXIT_FAILURE);
+    break;
+  case 7:
+    /* remove hands back the element without evicting it */
+    cp=copen(10,CACHE_LRU,0,0,evict_person);
+    put_person(cp,"steve",STEVE_AGE,1);
+    put_person(cp,"bill",BILL_AGE,1);
+    ep=cremove(cp,"steve",5);
+    check_person(ep,"steve",STEVE_AGE);
+    free_person(ep);
+    if(evicted!=0 || cremove(cp,"steve",5)!=NULL)
+      exit(EXIT_FAILURE);
+    check_absent(cp,"steve");
+    check_get(cp,"bill",BILL_AGE);
+    break;
+  case 8:
+    /* explicit eviction, then close releases what is left */
+    cp=copen(10,CACHE_LRU,0,0,evict_person);
+    if(cevict(cp)==0)
+      exit(EXIT_FAILURE);
+    put_person(cp,"steve",STEVE_AGE,1);
+    put_person(cp,"bill",BILL_AGE,1);
+    put_person(cp,"john",JOHN_AGE,1);
+    if(cevict(cp)!=0 || lastage!=STEVE_AGE)
+      exit(EXIT_FAILURE);
+    cclose(cp);
+    if(evicted!=3)
+      exit(EXIT_FAILURE);
+    exit(EXIT_SUCCESS);
+  case 9:
+    /* putting the same element again keeps it, resized */
+    cp=copen(10,CACHE_LRU,0,0,evict_person);
+    ep=make_person("steve",STEVE_AGE,SALARY);
+    if(cput(cp,ep,"steve",5,1)!=0 || cput(cp,ep,"steve",5,7)!=0)
+      exit(EXIT_FAILURE);
+    if(evicted!=0)
+      exit(EXIT_FAILURE);
+    check_get(cp,"steve",STEVE_AGE);
+    cstats(cp,&entries,&bytes,NULL,NULL);
+    if(entries!=1 || bytes!=7)
+      exit(EXIT_FAILURE);
+    break;
+  default:
+    exit(EXIT_FAILURE);
+  }
+  cclose(cp);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,98 @@
+/*
+ * tchash.c -- regression test for the compact hash module
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chash.h>
+#include <tutils.h>
+
+#define THASH_DEBUG 1
+
+#define MULTIPLE 100		/* #entries = 100*tablesize */
+
+static int nextage;		/* age chapply should visit next */
+static int step;		/* distance between ages visited */
+
+/* check entries are visited in insertion order */
+static void check_order(void *ep) {
+  person_t *pp=(person_t*)ep;
+
+  if(pp->age!=nextage)
+    exit(EXIT_FAILURE);
+  nextage+=step;
+}
+
+int main(int argc, char *argv[]) {
+  void *pp;
+  int key,tablesize;
+  chashtable_t *ht;
+  char nm[NAMESIZE];
+
+  if(argc!=2 || ((tablesize=atoi(argv[1]))<=0)) {
+    printf("[Usage: tchash <tablesize>]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* open a table and put MULTIPLE entries in it, forcing resizes */
+  ht=chopen((uint32_t)tablesize);
+  for(key=0;key<(MULTIPLE*tablesize);key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    pp = make_person(nm,key,SALARY);
+    if(chput(ht,(void*)pp,(char*)&key,sizeof(key))!=0)
+      exit(EXIT_FAILURE);
+  }
+  nextage=0;
+  step=1;
+  chapply(ht,check_order);
+  if(nextage!=MULTIPLE*tablesize)
+    exit(EXIT_FAILURE);
+#ifdef THASH_DEBUG
+  printf("[insertion order preserved]\n");
+#endif
+
+  /* search for and check every value that is known to be present */
+  for(key=(MULTIPLE*tablesize)-1; key>=0; key--) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    pp=(person_t*)chsearch(ht,is_age,(char*)&key,sizeof(key));
+    check_person(pp,nm,key);
+  }
+
+  /* search for something thats not there */
+  key=(MULTIPLE*tablesize);
+  if(chsearch(ht,is_age,(char*)&key,sizeof(key))!=NULL)
+    exit(EXIT_FAILURE);
+
+  /* remove the odd entries; the even ones stay in order */
+  for(key=1; key<(MULTIPLE*tablesize); key+=2) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    pp=(person_t*)chremove(ht,is_age,(char*)&key,sizeof(key));
+    check_person(pp,nm,key);
+    free_person(pp);
+    if(chsearch(ht,is_age,(char*)&key,sizeof(key))!=NULL)
+      exit(EXIT_FAILURE);
+  }
+  nextage=0;
+  step=2;
+  chapply(ht,check_order);
+
+  /* refill the holes -- reuses removed space, keeping order */
+  for(key=1; key<(MULTIPLE*tablesize); key+=2) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    if(chput(ht,make_person(nm,key,SALARY),(char*)&key,sizeof(key))!=0)
+      exit(EXIT_FAILURE);
+  }
+  for(key=0; key<(MULTIPLE*tablesize); key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    check_person(chsearch(ht,is_age,(char*)&key,sizeof(key)),nm,key);
+  }
+#ifdef THASH_DEBUG
+  printf("[search after removal succeeded]\n");
+#endif
+
+  /* close the table, freeing what is left, and terminate */
+  chclose(ht);
+  return(EXIT_SUCCESS);
+}
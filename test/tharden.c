@@ -0,0 +1,266 @@
+/*
+ * tharden.c -- regression test for hash flooding: keys chosen to
+ * collide under the unkeyed hash must not make lookups linear
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hash.h>
+#include <hashfn.h>
+#include <tutils.h>
+
+#define THASH_DEBUG 1
+
+#define TABLESIZE 1024		/* buckets */
+#define NKEYS 2000		/* colliding keys used in the attack */
+#define BOUND 64		/* most compares a lookup may make */
+#define SEED 12345		/* of the seeded SuperFastHash tables */
+#define NLEVELS 10		/* crafted keys are NLEVELS 8-byte pieces */
+#define NCRAFTED (1 << NLEVELS)	/* so there are 2^NLEVELS of them */
+#define CRAFTLEN (8*NLEVELS)
+
+static char crafted[NCRAFTED][CRAFTLEN];
+
+/* put a person under each key */
+static void put_keys(hashtable_t *ht, int keys[]) {
+  int i;
+
+  for(i=0; i<NKEYS; i++)
+    if(hput(ht,make_person("victim",keys[i],SALARY),
+	    (char*)&keys[i],sizeof(int))!=0)
+      exit(EXIT_FAILURE);
+}
+
+/* look every key up, returning the most compares any lookup made */
+static int worst_lookup(hashtable_t *ht, int keys[]) {
+  int i,worst;
+
+  for(worst=0, i=0; i<NKEYS; i++) {
+    search_compares=0;
+    check_person(hsearch(ht,is_age_counted,(char*)&keys[i],sizeof(int)),
+		 "victim",keys[i]);
+    if(search_compares>worst)
+      worst=search_compares;
+  }
+  return worst;
+}
+
+/* one 4-byte round of the main loop of SuperFastHash (see hashfn.c) */
+static uint32_t sfh_round(uint32_t h, uint16_t lo, uint16_t hi) {
+  uint32_t tmp;
+
+  h+=lo;
+  tmp=((uint32_t)hi << 11)^h;
+  h=(h << 16)^tmp;
+  h+=h >> 11;
+  return h;
+}
+
+/*
+ * craft_keys -- keys whose whole unkeyed SuperFastHash is the same:
+ * each 8-byte piece of a key is one of two pairs of rounds leading
+ * from the same state to the same state, so every choice collides.
+ * The first pair is all zeros; the second starts 1 higher, and its
+ * second round's low half cancels the low bits of the state and its
+ * high half the rest (possible once the top 5 bits agree)
+ */
+static void craft_keys(void) {
+  uint16_t pieces[NLEVELS][2][4],lo;
+  uint32_t h,ha,hb;
+  int l,k;
+
+  h=CRAFTLEN;			/* the initial state: len ^ seed 0 */
+  for(l=0; l<NLEVELS; l++) {
+    ha=sfh_round(h,0,0);
+    for(lo=1; ; lo++) {
+      hb=sfh_round(h,lo,0)+(uint16_t)(ha-sfh_round(h,lo,0));
+      if(((ha^hb) >> 27)==0)
+	break;
+    }
+    memset(pieces[l][0],0,sizeof(pieces[l][0]));
+    pieces[l][1][0]=lo;
+    pieces[l][1][1]=0;
+    pieces[l][1][2]=(uint16_t)(ha-sfh_round(h,lo,0));
+    pieces[l][1][3]=(uint16_t)(((ha^hb) >> 16) << 5);
+    h=sfh_round(ha,0,0);
+  }
+  for(k=0; k<NCRAFTED; k++)
+    for(l=0; l<NLEVELS; l++)
+      memcpy(crafted[k]+8*l,pieces[l][(k >> l) & 1],8);
+}
+
+static bool is_crafted(void *ep, const void *keyp) {
+  search_compares++;
+  return memcmp(ep,keyp,CRAFTLEN)==0;
+}
+
+static const char *crafted_key(void *ep, int32_t *keylenp) {
+  *keylenp=CRAFTLEN;
+  return (const char*)ep;
+}
+
+/* put a copy of each crafted key, as its own element */
+static void put_crafted(hashtable_t *ht) {
+  char *ep;
+  int k;
+
+  for(k=0; k<NCRAFTED; k++) {
+    if((ep=malloc(CRAFTLEN))==NULL)
+      exit(EXIT_FAILURE);
+    memcpy(ep,crafted[k],CRAFTLEN);
+    if(hput(ht,ep,ep,CRAFTLEN)!=0)
+      exit(EXIT_FAILURE);
+  }
+}
+
+/* look every crafted key up, returning the most compares made */
+static int worst_crafted(hashtable_t *ht) {
+  int k,worst;
+
+  for(worst=0, k=0; k<NCRAFTED; k++) {
+    search_compares=0;
+    if(hsearch(ht,is_crafted,crafted[k],CRAFTLEN)==NULL)
+      exit(EXIT_FAILURE);
+    if(search_compares>worst)
+      worst=search_compares;
+  }
+  return worst;
+}
+
+static int cmp_hash(const void *a, const void *b) {
+  uint64_t x=*(const uint64_t*)a, y=*(const uint64_t*)b;
+  return (x>y)-(x<y);
+}
+
+/* the number of distinct full hashes the table gives crafted keys */
+static int distinct_hashes(hashtable_t *ht) {
+  static uint64_t hashes[NCRAFTED];
+  int k,n;
+
+  for(k=0; k<NCRAFTED; k++)
+    hashes[k]=hhash(ht,crafted[k],CRAFTLEN);
+  qsort(hashes,NCRAFTED,sizeof(uint64_t),cmp_hash);
+  for(n=1, k=1; k<NCRAFTED; k++)
+    if(hashes[k]!=hashes[k-1])
+      n++;
+  return n;
+}
+
+int main(void) {
+  hashtable_t *ht;
+  int keys[NKEYS],key,n,worst;
+
+  /* find keys that all land in bucket 0 under the unkeyed hash */
+  for(n=0, key=0; n<NKEYS; key++)
+    if(SuperFastHash((char*)&key,sizeof(key)) % TABLESIZE == 0)
+      keys[n++]=key;
+
+  /* the attack: without protection lookups walk one long chain */
+  ht=hopen_seed(TABLESIZE,0);
+  put_keys(ht,keys);
+  worst=worst_lookup(ht,keys);
+#ifdef THASH_DEBUG
+  printf("[unprotected: worst lookup %d compares]\n",worst);
+#endif
+  if(worst!=NKEYS)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* a table with a key function detects the chain and hardens */
+  ht=hopen_seed(TABLESIZE,0);
+  hsetkeyfn(ht,age_key);
+  put_keys(ht,keys);
+  worst=worst_lookup(ht,keys);
+#ifdef THASH_DEBUG
+  printf("[detected: worst lookup %d compares]\n",worst);
+#endif
+  if(worst>BOUND)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* a differently seeded table is not attacked by these keys at all */
+  ht=hopen_seed(TABLESIZE,SEED);
+  put_keys(ht,keys);
+  worst=worst_lookup(ht,keys);
+#ifdef THASH_DEBUG
+  printf("[seeded: worst lookup %d compares]\n",worst);
+#endif
+  if(worst>BOUND)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* a table hardened up front */
+  ht=hopen_seed(TABLESIZE,0);
+  if(hharden(ht)!=0)
+    exit(EXIT_FAILURE);
+  put_keys(ht,keys);
+  worst=worst_lookup(ht,keys);
+  if(worst>BOUND)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* keys crafted to collide in the whole unkeyed hash, not just
+     modulo the table size */
+  craft_keys();
+  ht=hopen_seed(TABLESIZE,0);
+  if(distinct_hashes(ht)!=1)
+    exit(EXIT_FAILURE);
+  put_crafted(ht);
+  if(worst_crafted(ht)!=NCRAFTED)
+    exit(EXIT_FAILURE);
+  /* a table without a key function cannot harden once it has entries */
+  if(hharden(ht)==0)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* with a key function the table hardens, and SipHash spreads them */
+  ht=hopen_seed(TABLESIZE,0);
+  hsetkeyfn(ht,crafted_key);
+  put_crafted(ht);
+  worst=worst_crafted(ht);
+#ifdef THASH_DEBUG
+  printf("[crafted, detected: %d hashes, worst lookup %d compares]\n",
+	 distinct_hashes(ht),worst);
+#endif
+  if(distinct_hashes(ht)!=NCRAFTED || worst>BOUND)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* as does hardening a plain table while it is empty */
+  ht=hopen_seed(TABLESIZE,0);
+  if(hharden(ht)!=0)
+    exit(EXIT_FAILURE);
+  put_crafted(ht);
+  if(distinct_hashes(ht)!=NCRAFTED || worst_crafted(ht)>BOUND)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* a seed alone only blunts them: SuperFastHash is too weakly keyed
+     to stop some colliding (up to 32 keys a hash over 2000 seeds
+     tried), which is why tables harden */
+  ht=hopen_seed(TABLESIZE,SEED);
+  put_crafted(ht);
+  worst=worst_crafted(ht);
+#ifdef THASH_DEBUG
+  printf("[crafted, seeded: %d hashes, worst lookup %d compares]\n",
+	 distinct_hashes(ht),worst);
+#endif
+  if(distinct_hashes(ht)<NCRAFTED/16 || worst>NCRAFTED/4)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+
+  /* a table from hopen hashes with SipHash from the start */
+  ht=hopen(TABLESIZE);
+  put_crafted(ht);
+  if(distinct_hashes(ht)!=NCRAFTED || worst_crafted(ht)>BOUND)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+  ht=hopen(TABLESIZE);
+  put_keys(ht,keys);
+  if(worst_lookup(ht,keys)>BOUND)
+    exit(EXIT_FAILURE);
+  hclose(ht);
+  return(EXIT_SUCCESS);
+}
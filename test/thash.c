@@ -13,11 +13,37 @@
 
 #define MULTIPLE 100		/* #entries = 100*tablesize */
 
+/* make a person for hupsert, earning *arg */
+static void *make_earner(const char *key, int32_t keylen, void *arg) {
+  if(keylen!=sizeof(int))
+    exit(EXIT_FAILURE);
+  return make_person("earner",*(const int*)key,*(double*)arg);
+}
+
+/* give a person a raise of *arg */
+static void raise_salary(void *ep, void *arg) {
+  ((person_t*)ep)->salary+=*(double*)arg;
+}
+
+/* count a visit to a person by hscan; ctx is the counts, by age */
+static void count_visit(void *ep, void *ctx) {
+  ((int*)ctx)[((person_t*)ep)->age]++;
+}
+
 int main(int argc, char *argv[]) {
   void *pp;
-  int key,tablesize;
-  hashtable_t *ht;
+  int key,tablesize,n;
+  hashtable_t *ht,*src;
   char nm[NAMESIZE];
+  void **elems;
+  const char **keys;
+  int32_t *keylens;
+  int *keyv;
+  double raise;
+  uint64_t h;
+  hmem_t before,after;
+  uint64_t cursor;
+  int *visits,calls;
 
   if(argc!=2 || ((tablesize=atoi(argv[1]))<=0)) {
     printf("[Usage: thash <tablesize>]\n");
@@ -78,6 +104,190 @@ int main(int argc, char *argv[]) {
   happly(ht,print_person);
 #endif
 
+  /* refill the table in bulk and check every entry is found */
+  n=MULTIPLE*tablesize;
+  elems=malloc(n*sizeof(void*));
+  keys=malloc(n*sizeof(char*));
+  keylens=malloc(n*sizeof(int32_t));
+  keyv=malloc(n*sizeof(int));
+  if(elems==NULL || keys==NULL || keylens==NULL || keyv==NULL)
+    exit(EXIT_FAILURE);
+  for(key=0;key<n;key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    elems[key]=make_person(nm,key,SALARY);
+    keyv[key]=key;
+    keys[key]=(char*)&keyv[key];
+    keylens[key]=sizeof(int);
+  }
+  if(hbuild(ht,elems,keys,keylens,(uint32_t)n)!=0)
+    exit(EXIT_FAILURE);
+  for(key=n-1; key>=0; key--) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    pp=(person_t*)hsearch(ht,is_age,(char*)&key,sizeof(key));
+    check_person(pp,nm,key);
+  }
+  free(elems);
+  free(keys);
+  free(keylens);
+  free(keyv);
+#ifdef THASH_DEBUG
+  printf("[bulk build succeeded]\n");
+#endif
+
+  /* merge in a table of the same size, then one of another size */
+  if(hmerge_parallel(ht,put_people(hopen_like(ht),n,2*n),NULL,4)!=0)
+    exit(EXIT_FAILURE);
+  check_people(ht,0,2*n);
+  src=put_people(hopen((uint32_t)tablesize+1),2*n,3*n);
+  if(hmerge(ht,src,NULL)==0)	/* no key function -- refused */
+    exit(EXIT_FAILURE);
+  if(hmerge(ht,src,age_key)!=0)
+    exit(EXIT_FAILURE);
+  check_people(ht,0,3*n);
+#ifdef THASH_DEBUG
+  printf("[merges succeeded]\n");
+#endif
+
+  hclose(ht);
+
+  /* count into a table: a raise for everyone there, a new person for
+   * everyone not
+   */
+  ht=put_people(hopen_seed((uint64_t)n,1),0,n); /* the scan hardens it */
+  raise=1.0;
+  for(key=0; key<2*n; key++) {
+    pp=hupsert(ht,is_age,(char*)&key,sizeof(key),make_earner,raise_salary,
+	       &raise);
+    if(pp==NULL || ((person_t*)pp)->age!=key)
+      exit(EXIT_FAILURE);
+  }
+  check_people(ht,0,n);
+  for(key=0; key<2*n; key++) {
+    pp=hsearch(ht,is_age,(char*)&key,sizeof(key));
+    if(((person_t*)pp)->salary!=(key<n ? SALARY+raise : raise))
+      exit(EXIT_FAILURE);
+  }
+
+  /* put only the people not there already */
+  for(key=n; key<3*n; key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    pp=make_person(nm,key,SALARY);
+    if(hput_if_absent(ht,pp,is_age,(char*)&key,sizeof(key))==pp) {
+      if(key<2*n)		/* was there */
+	exit(EXIT_FAILURE);
+    }
+    else {
+      if(key>=2*n)
+	exit(EXIT_FAILURE);
+      free_person(pp);
+    }
+  }
+  check_people(ht,2*n,3*n);
+
+  /* hash once, then remove and search with the hash */
+  for(key=0; key<3*n; key++) {
+    h=hhash(ht,(char*)&key,sizeof(key));
+    pp=hremove_h(ht,is_age,(char*)&key,h);
+    if(pp==NULL || ((person_t*)pp)->age!=key)
+      exit(EXIT_FAILURE);
+    if(hsearch_h(ht,is_age,(char*)&key,h)!=NULL)
+      exit(EXIT_FAILURE);
+    if(hput_h(ht,pp,h)!=0)
+      exit(EXIT_FAILURE);
+    if(hsearch_h(ht,is_age,(char*)&key,h)!=pp)
+      exit(EXIT_FAILURE);
+  }
+#ifdef THASH_DEBUG
+  printf("[upserts succeeded]\n");
+#endif
+
+  /* remove most entries, then give the memory back */
+  for(key=n/10; key<3*n; key++)
+    free_person(hremove(ht,is_age,(char*)&key,sizeof(key)));
+  hmemusage(ht,&before);
+  if(before.freelinks==0 || before.links==0)
+    exit(EXIT_FAILURE);
+  if(hshrink(ht,0)==0)		/* no key function -- cannot rehash */
+    exit(EXIT_FAILURE);
+  hmemusage(ht,&after);
+  if(after.freelinks!=0 || after.buckets!=before.buckets)
+    exit(EXIT_FAILURE);
+  hsetkeyfn(ht,age_key);
+  if(hshrink(ht,0)!=0)
+    exit(EXIT_FAILURE);
+  hmemusage(ht,&after);
+  if(after.buckets>=before.buckets || after.queues>=before.queues ||
+     after.links!=before.links)
+    exit(EXIT_FAILURE);
+  check_people(ht,0,n/10);
+  key=n/10;
+  if(hsearch(ht,is_age,(char*)&key,sizeof(key))!=NULL)
+    exit(EXIT_FAILURE);
+  put_people(ht,n/10,n);	/* and grows as before */
+  check_people(ht,0,n);
+#ifdef THASH_DEBUG
+  printf("[shrink succeeded]\n");
+#endif
+
+  /* scan a few buckets at a time while the table changes: people
+   * aged below n/2 stay throughout, the rest leave, newcomers arrive,
+   * and the table is rehashed part way
+   */
+  visits=calloc(2*n,sizeof(int));
+  if(visits==NULL)
+    exit(EXIT_FAILURE);
+  cursor=0;
+  calls=0;
+  do {
+    cursor=hscan(ht,cursor,7,count_visit,visits);
+    key=n/2+calls;
+    if(key<n)
+      free_person(hremove(ht,is_age,(char*)&key,sizeof(key)));
+    if(n+calls<2*n)
+      put_people(ht,n+calls,n+calls+1);
+    if(++calls==3 && hharden(ht)!=0)
+      exit(EXIT_FAILURE);
+  } while(cursor!=0);
+  for(key=0; key<n/2; key++)
+    if(visits[key]==0)
+      exit(EXIT_FAILURE);
+  /* and undisturbed, each exactly once */
+  memset(visits,0,2*n*sizeof(int));
+  cursor=0;
+  do
+    cursor=hscan(ht,cursor,7,count_visit,visits);
+  while(cursor!=0);
+  for(key=0; key<2*n; key++) {
+    pp=hsearch(ht,is_age,(char*)&key,sizeof(key));
+    if(visits[key]!=(pp!=NULL ? 1 : 0))
+      exit(EXIT_FAILURE);
+  }
+  free(visits);
+#ifdef THASH_DEBUG
+  printf("[scan succeeded]\n");
+#endif
+
+  /* hashes taken before a table hardens are stale after, and refused */
+  src=put_people(hopen_seed((uint32_t)tablesize,1),0,n);
+  hsetkeyfn(src,age_key);
+  key=0;
+  h=hhash(src,(char*)&key,sizeof(key));
+  if(!hcurrent(src,h) || hharden(src)!=0 || hcurrent(src,h))
+    exit(EXIT_FAILURE);
+  pp=make_person("stale",key,SALARY);
+  if(hput_h(src,pp,h)==0 || hsearch_h(src,is_age,(char*)&key,h)!=NULL ||
+     hremove_h(src,is_age,(char*)&key,h)!=NULL)
+    exit(EXIT_FAILURE);
+  free_person(pp);
+  h=hhash(src,(char*)&key,sizeof(key));
+  if(!hcurrent(src,h))
+    exit(EXIT_FAILURE);
+  check_person(hsearch_h(src,is_age,(char*)&key,h),"nm0",key);
+  hclose(src);
+#ifdef THASH_DEBUG
+  printf("[stale hashes refused]\n");
+#endif
+
   /* close the hash table and terminate */
   hclose(ht);
   return(EXIT_SUCCESS);
@@ -0,0 +1,106 @@
+/*
+ * tlhash.c -- regression test for the lean hash module
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lhash.h>
+#include <tutils.h>
+
+#define THASH_DEBUG 1
+
+#define MULTIPLE 10		/* #entries = 10*tablesize */
+
+static int visited;		/* entries lhapply visited */
+static int agesum;		/* and the sum of their ages */
+
+static void count_person(void *ep) {
+  visited++;
+  agesum+=((person_t*)ep)->age;
+}
+
+int main(int argc, char *argv[]) {
+  void *pp;
+  int key,tablesize,n,sum;
+  lhashtable_t *ht;
+  char nm[NAMESIZE];
+
+  if(argc!=2 || ((tablesize=atoi(argv[1]))<=0)) {
+    printf("[Usage: tlhash <tablesize>]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* open a table and put MULTIPLE entries per bucket in it */
+  ht=lhopen((uint32_t)tablesize);
+  n=MULTIPLE*tablesize;
+  for(key=0;key<n;key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    pp = make_person(nm,key,SALARY);
+    if(lhput(ht,(void*)pp,(char*)&key,sizeof(key))!=0)
+      exit(EXIT_FAILURE);
+  }
+  for(sum=0, key=0; key<n; key++)
+    sum+=key;
+  lhapply(ht,count_person);
+  if(visited!=n || agesum!=sum)
+    exit(EXIT_FAILURE);
+
+  /* search for and check every value that is known to be present */
+  for(key=n-1; key>=0; key--) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    pp=(person_t*)lhsearch(ht,is_age,(char*)&key,sizeof(key));
+    check_person(pp,nm,key);
+  }
+
+  /* search for something thats not there */
+  key=n;
+  if(lhsearch(ht,is_age,(char*)&key,sizeof(key))!=NULL ||
+     lhremove(ht,is_age,(char*)&key,sizeof(key))!=NULL)
+    exit(EXIT_FAILURE);
+#ifdef THASH_DEBUG
+  printf("[search succeeded]\n");
+#endif
+
+  /* remove the odd entries, wherever they are in their chains */
+  for(key=1; key<n; key+=2) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    pp=(person_t*)lhremove(ht,is_age,(char*)&key,sizeof(key));
+    check_person(pp,nm,key);
+    free_person(pp);
+    if(lhsearch(ht,is_age,(char*)&key,sizeof(key))!=NULL)
+      exit(EXIT_FAILURE);
+  }
+  for(key=0; key<n; key+=2) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    check_person(lhsearch(ht,is_age,(char*)&key,sizeof(key)),nm,key);
+  }
+
+  /* refill the holes from the free links */
+  for(key=1; key<n; key+=2) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    if(lhput(ht,make_person(nm,key,SALARY),(char*)&key,sizeof(key))!=0)
+      exit(EXIT_FAILURE);
+  }
+  for(key=0; key<n; key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    check_person(lhsearch(ht,is_age,(char*)&key,sizeof(key)),nm,key);
+  }
+
+  /* of equal keys the last put is found first, then the one before */
+  key=0;
+  if(lhput(ht,make_person("second",key,SALARY),(char*)&key,sizeof(key))!=0)
+    exit(EXIT_FAILURE);
+  pp=lhremove(ht,is_age,(char*)&key,sizeof(key));
+  check_person(pp,"second",key);
+  free_person(pp);
+  check_person(lhsearch(ht,is_age,(char*)&key,sizeof(key)),"nm0",key);
+#ifdef THASH_DEBUG
+  printf("[search after removal succeeded]\n");
+#endif
+
+  /* close the table, freeing what is left, and terminate */
+  lhclose(ht);
+  return(EXIT_SUCCESS);
+}
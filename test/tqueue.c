@@ -14,22 +14,35 @@
 
 static void single_queue(int test);
 static void multi_queue(int test);
+static void handle_queue(int test);
+static void sort_queue(int test);
+static void memory_queue(int test);
+static void batch_queue(int test);
+static int by_age(void *e1p, void *e2p);
 static int cnt;
 static void cntelements(void *ep);
 
 int main(int argc, char *argv[]) {
   int test;
   if(argc!=2) {
-    printf("Usage: %s <testnumber> -- testnumber=1-20\n",argv[0]);
+    printf("Usage: %s <testnumber> -- testnumber=1-35\n",argv[0]);
     exit(EXIT_FAILURE);
   }
   test=atoi(argv[1]);
-  if(test<=0 || test>20)
+  if(test<=0 || test>35)
     exit(EXIT_FAILURE);
   if (test>0 && test<7) 
     single_queue(test);
-  else
+  else if (test<21)
     multi_queue(test);
+  else if (test<26)
+    handle_queue(test);
+  else if (test<31)
+    sort_queue(test);
+  else if (test<33)
+    memory_queue(test);
+  else
+    batch_queue(test);
   exit(EXIT_SUCCESS);
 }
 
@@ -370,3 +383,335 @@ static void multi_queue(int test) {
     break;
   }
 }
+
+static void handle_queue(int test) {
+  queue_t *qp;
+  qhandle_t *h1,*h2,*h3;
+  void *ep;
+
+  /* put 3 people in a queue, keeping their handles */
+  qp=qopen();
+  h1=qput_handle(qp,make_person("steve",STEVE_AGE,SALARY));
+  h2=qput_handle(qp,make_person("bill",BILL_AGE,SALARY));
+  h3=qput_handle(qp,make_person("john",JOHN_AGE,SALARY));
+  if(h1==NULL || h2==NULL || h3==NULL)
+    exit(EXIT_FAILURE);
+
+  switch(test) {
+  case 21:
+    /* remove front by handle */
+    ep=qremove_handle(qp,h1);
+    check_person(ep,"steve",STEVE_AGE);
+    free_person(ep);
+    get_n_check(qp,"bill",BILL_AGE);
+    get_n_check(qp,"john",JOHN_AGE);
+    check_empty(qp);
+    break;
+  case 22:
+    /* remove middle and back by handle, then put again */
+    ep=qremove_handle(qp,h2);
+    check_person(ep,"bill",BILL_AGE);
+    free_person(ep);
+    ep=qremove_handle(qp,h3);
+    check_person(ep,"john",JOHN_AGE);
+    free_person(ep);
+    if(qput(qp,make_person("cory",CORY_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    get_n_check(qp,"steve",STEVE_AGE);
+    get_n_check(qp,"cory",CORY_AGE);
+    check_empty(qp);
+    break;
+  case 23:
+    /* move front to back */
+    qmove_to_back(qp,h1);
+    get_n_check(qp,"bill",BILL_AGE);
+    get_n_check(qp,"john",JOHN_AGE);
+    get_n_check(qp,"steve",STEVE_AGE);
+    check_empty(qp);
+    break;
+  case 24:
+    /* move middle, then back (a no-op), to back */
+    qmove_to_back(qp,h2);
+    qmove_to_back(qp,h2);
+    get_n_check(qp,"steve",STEVE_AGE);
+    get_n_check(qp,"john",JOHN_AGE);
+    get_n_check(qp,"bill",BILL_AGE);
+    check_empty(qp);
+    break;
+  case 25:
+    /* remove everything by handle, leaving an empty usable queue */
+    free_person(qremove_handle(qp,h3));
+    free_person(qremove_handle(qp,h1));
+    free_person(qremove_handle(qp,h2));
+    check_empty(qp);
+    h1=qput_handle(qp,make_person("cory",CORY_AGE,SALARY));
+    ep=qremove_handle(qp,h1);
+    check_person(ep,"cory",CORY_AGE);
+    free_person(ep);
+    check_empty(qp);
+    break;
+  default:
+    exit(EXIT_FAILURE);
+    break;
+  }
+  qclose(qp);
+}
+
+static int by_age(void *e1p, void *e2p) {
+  return ((person_t*)e1p)->age - ((person_t*)e2p)->age;
+}
+
+static void sort_queue(int test) {
+  queue_t *q1,*q2;
+  qhandle_t *h;
+  int i;
+
+  q1=qopen();
+  q2=qopen();
+  switch(test) {
+  case 26:
+    /* sort empty and single element queues */
+    qsort_by(q1,by_age);
+    check_empty(q1);
+    if(qput(q1,make_person("steve",STEVE_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    qsort_by(q1,by_age);
+    get_n_check(q1,"steve",STEVE_AGE);
+    check_empty(q1);
+    break;
+  case 27:
+    /* sort NUMELEMENTS ages in scrambled order, with duplicates
+     * named by their original position to check stability
+     */
+    for(i=0; i<NUMELEMENTS; i++) {
+      if(qput(q1,make_person(i<NUMELEMENTS/2 ? "first" : "second",
+			     (i*37)%(NUMELEMENTS/2),SALARY))!=0)
+	exit(EXIT_FAILURE);
+    }
+    qsort_by(q1,by_age);
+    for(i=0; i<NUMELEMENTS/2; i++) {
+      get_n_check(q1,"first",i);
+      get_n_check(q1,"second",i);
+    }
+    check_empty(q1);
+    break;
+  case 28:
+    /* handles survive a sort; back is fixed up */
+    if(qput(q1,make_person("john",JOHN_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    h=qput_handle(q1,make_person("steve",STEVE_AGE,SALARY));
+    if(qput(q1,make_person("bill",BILL_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    qsort_by(q1,by_age);
+    qmove_to_back(q1,h);
+    if(qput(q1,make_person("cory",CORY_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    get_n_check(q1,"bill",BILL_AGE);
+    get_n_check(q1,"john",JOHN_AGE);
+    get_n_check(q1,"steve",STEVE_AGE);
+    get_n_check(q1,"cory",CORY_AGE);
+    check_empty(q1);
+    break;
+  case 29:
+    /* merge two sorted queues, q1 first on ties */
+    if(qput(q1,make_person("steve",STEVE_AGE,SALARY))!=0 ||
+       qput(q1,make_person("john",JOHN_AGE,SALARY))!=0 ||
+       qput(q1,make_person("george",GEORGE_AGE,SALARY))!=0 ||
+       qput(q2,make_person("bill",BILL_AGE,SALARY))!=0 ||
+       qput(q2,make_person("jim",JOHN_AGE,SALARY))!=0 ||
+       qput(q2,make_person("cory",CORY_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    qmerge(q1,q2,by_age);
+    get_n_check(q1,"steve",STEVE_AGE);
+    get_n_check(q1,"bill",BILL_AGE);
+    get_n_check(q1,"john",JOHN_AGE);
+    get_n_check(q1,"jim",JOHN_AGE);
+    get_n_check(q1,"george",GEORGE_AGE);
+    get_n_check(q1,"cory",CORY_AGE);
+    check_empty(q1);
+    qclose(q1);
+    return;			/* q2 is closed */
+  case 30:
+    /* merge into an empty queue, then put at the back */
+    if(qput(q2,make_person("steve",STEVE_AGE,SALARY))!=0 ||
+       qput(q2,make_person("bill",BILL_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    qmerge(q1,q2,by_age);
+    if(qput(q1,make_person("cory",CORY_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    get_n_check(q1,"steve",STEVE_AGE);
+    get_n_check(q1,"bill",BILL_AGE);
+    get_n_check(q1,"cory",CORY_AGE);
+    check_empty(q1);
+    qclose(q1);
+    return;			/* q2 is closed */
+  default:
+    exit(EXIT_FAILURE);
+    break;
+  }
+  qclose(q1);
+  qclose(q2);
+}
+
+static void memory_queue(int test) {
+  queue_t *qp;
+  qmem_t m;
+  uint64_t linksize,freelinks;
+  int i;
+
+  qp=qopen();
+  switch(test) {
+  case 31:
+    /* links are counted as they move to the free list and are trimmed */
+    memset(&m,0,sizeof(m));
+    qmemusage(qp,&m);
+    if(m.header==0 || m.links!=0 || m.freelinks!=0)
+      exit(EXIT_FAILURE);
+    for(i=0; i<NUMELEMENTS; i++)
+      if(qput(qp,make_person("steve",STEVE_AGE,SALARY))!=0)
+	exit(EXIT_FAILURE);
+    memset(&m,0,sizeof(m));
+    qmemusage(qp,&m);
+    linksize=m.links/NUMELEMENTS;
+    if(linksize==0 || m.links!=linksize*NUMELEMENTS)
+      exit(EXIT_FAILURE);
+    for(i=0; i<NUMELEMENTS; i++)
+      free_person(qget(qp));
+    memset(&m,0,sizeof(m));
+    qmemusage(qp,&m);
+    if(m.links!=0 || m.freelinks==0 || m.freelinks>linksize*NUMELEMENTS)
+      exit(EXIT_FAILURE);
+    if(qtrim(qp)!=m.freelinks)
+      exit(EXIT_FAILURE);
+    freelinks=m.freelinks;
+    memset(&m,0,sizeof(m));
+    qmemusage(qp,&m);
+    if(m.freelinks!=0)
+      exit(EXIT_FAILURE);
+    /* and the limit on cached links is as it was before the trim */
+    for(i=0; i<NUMELEMENTS; i++)
+      if(qput(qp,make_person("steve",STEVE_AGE,SALARY))!=0)
+	exit(EXIT_FAILURE);
+    for(i=0; i<NUMELEMENTS; i++)
+      free_person(qget(qp));
+    memset(&m,0,sizeof(m));
+    qmemusage(qp,&m);
+    if(m.freelinks!=freelinks)
+      exit(EXIT_FAILURE);
+    break;
+  case 32:
+    /* a trimmed queue still works, and caches links again */
+    for(i=0; i<NUMELEMENTS; i++)
+      if(qput(qp,make_person("bill",BILL_AGE,SALARY))!=0)
+	exit(EXIT_FAILURE);
+    for(i=0; i<NUMELEMENTS/2; i++)
+      get_n_check(qp,"bill",BILL_AGE);
+    qtrim(qp);
+    if(qput(qp,make_person("cory",CORY_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    for(i=0; i<NUMELEMENTS/2; i++)
+      get_n_check(qp,"bill",BILL_AGE);
+    get_n_check(qp,"cory",CORY_AGE);
+    check_empty(qp);
+    if(qtrim(qp)==0)
+      exit(EXIT_FAILURE);
+    break;
+  default:
+    exit(EXIT_FAILURE);
+    break;
+  }
+  qclose(qp);
+}
+
+/* put NUMELEMENTS people aged 0.. into q with one qput_n */
+static void put_batch(queue_t *qp) {
+  void *elems[NUMELEMENTS];
+  int i;
+
+  for(i=0; i<NUMELEMENTS; i++)
+    elems[i]=make_person("batch",i,SALARY);
+  if(qput_n(qp,elems,NUMELEMENTS)!=0)
+    exit(EXIT_FAILURE);
+}
+
+static void batch_queue(int test) {
+  queue_t *qp;
+  void *out[2*NUMELEMENTS];
+  qmem_t m;
+  int i;
+
+  qp=qopen();
+  switch(test) {
+  case 33:
+    /* a batch put behind a single put comes out in order */
+    if(qput_n(qp,out,0)!=0)
+      exit(EXIT_FAILURE);
+    check_empty(qp);
+    if(qput(qp,make_person("steve",STEVE_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    put_batch(qp);
+    if(qput(qp,make_person("cory",CORY_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    /* prev links are right: remove from the middle of the batch */
+    i=NUMELEMENTS/2;
+    free_person(qremove(qp,is_age,&i));
+    get_n_check(qp,"steve",STEVE_AGE);
+    for(i=0; i<NUMELEMENTS; i++)
+      if(i!=NUMELEMENTS/2)
+	get_n_check(qp,"batch",i);
+    get_n_check(qp,"cory",CORY_AGE);
+    check_empty(qp);
+    break;
+  case 34:
+    /* batch gets in pieces; the free list takes what it has room for */
+    put_batch(qp);
+    if(qget_n(qp,out,NUMELEMENTS/4)!=NUMELEMENTS/4)
+      exit(EXIT_FAILURE);
+    for(i=0; i<NUMELEMENTS/4; i++) {
+      check_person(out[i],"batch",i);
+      free_person(out[i]);
+    }
+    if(qget_n(qp,out,2*NUMELEMENTS)!=NUMELEMENTS-NUMELEMENTS/4)
+      exit(EXIT_FAILURE);
+    for(i=NUMELEMENTS/4; i<NUMELEMENTS; i++) {
+      check_person(out[i-NUMELEMENTS/4],"batch",i);
+      free_person(out[i-NUMELEMENTS/4]);
+    }
+    if(qget_n(qp,out,NUMELEMENTS)!=0)
+      exit(EXIT_FAILURE);
+    check_empty(qp);
+    memset(&m,0,sizeof(m));
+    qmemusage(qp,&m);
+    if(m.freelinks==0)
+      exit(EXIT_FAILURE);
+    /* the cached links are reused by the next batch */
+    put_batch(qp);
+    memset(&m,0,sizeof(m));
+    qmemusage(qp,&m);
+    if(m.freelinks!=0)
+      exit(EXIT_FAILURE);
+    break;
+  case 35:
+    /* drain everything, then keep using the queue */
+    put_batch(qp);
+    put_batch(qp);
+    if(qdrain(qp,out)!=2*NUMELEMENTS)
+      exit(EXIT_FAILURE);
+    for(i=0; i<2*NUMELEMENTS; i++) {
+      check_person(out[i],"batch",i%NUMELEMENTS);
+      free_person(out[i]);
+    }
+    check_empty(qp);
+    if(qdrain(qp,out)!=0)
+      exit(EXIT_FAILURE);
+    if(qput(qp,make_person("bill",BILL_AGE,SALARY))!=0)
+      exit(EXIT_FAILURE);
+    get_n_check(qp,"bill",BILL_AGE);
+    check_empty(qp);
+    break;
+  default:
+    exit(EXIT_FAILURE);
+    break;
+  }
+  qclose(qp);
+}
@@ -0,0 +1,158 @@
+/*
+ * tshared.c -- regression test for the shared-memory hash table
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <shash.h>
+
+#define TSHARED_DEBUG 1
+
+#define NPROCS 4		/* processes sharing the table */
+#define NKEYS 2000		/* keys put by each */
+#define HSIZE 1024
+#define BYTES (4*1024*1024)
+
+static char name[64];
+
+/* child i puts keys i*NKEYS.., then reads back everyone's it can see */
+static void child(int i) {
+  shashtable_t *shp;
+  int64_t key,val;
+  int32_t n;
+
+  if((shp=hopen_shared(name,HSIZE,BYTES))==NULL)
+    _exit(EXIT_FAILURE);
+  for(key=i*NKEYS; key<(i+1)*NKEYS; key++) {
+    val=key*2;
+    if(hput_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=0)
+      _exit(EXIT_FAILURE);
+  }
+  for(key=0; key<NPROCS*NKEYS; key++) {
+    n=hget_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val));
+    if(n!=-1 && (n!=sizeof(val) || val!=key*2))
+      _exit(EXIT_FAILURE);	/* a torn or wrong value */
+  }
+  hclose_shared(shp);
+  _exit(EXIT_SUCCESS);
+}
+
+/* put keys forever, with values of varying size */
+static void writer(void) {
+  shashtable_t *shp;
+  char val[200];
+  int64_t key;
+
+  if((shp=hopen_shared(name,HSIZE,BYTES))==NULL)
+    _exit(EXIT_FAILURE);
+  memset(val,'x',sizeof(val));
+  for(key=0; ; key=(key+1)%NKEYS)
+    hput_shared(shp,(char*)&key,sizeof(key),val,(int32_t)(key%sizeof(val)));
+}
+
+int main(void) {
+  shashtable_t *shp;
+  int64_t key,val;
+  pid_t pids[NPROCS],pid;
+  int i,status,fd;
+  struct timespec pause={ 0, 0 };
+
+  snprintf(name,sizeof(name),"/tshared_%d",(int)getpid());
+  hunlink_shared(name);
+
+  /* several processes fill the table at once */
+  for(i=0; i<NPROCS; i++)
+    if((pids[i]=fork())==0)
+      child(i);
+    else if(pids[i]<0)
+      exit(EXIT_FAILURE);
+  for(i=0; i<NPROCS; i++)
+    if(waitpid(pids[i],&status,0)!=pids[i] || !WIFEXITED(status) ||
+       WEXITSTATUS(status)!=EXIT_SUCCESS)
+      exit(EXIT_FAILURE);
+  if((shp=hopen_shared(name,HSIZE,BYTES))==NULL)
+    exit(EXIT_FAILURE);
+  if(hentries_shared(shp)!=NPROCS*NKEYS)
+    exit(EXIT_FAILURE);
+  for(key=0; key<NPROCS*NKEYS; key++)
+    if(hget_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=sizeof(val) ||
+       val!=key*2)
+      exit(EXIT_FAILURE);
+  /* replace, truncate and remove */
+  key=7;
+  val=-1;
+  if(hput_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=0 ||
+     hget_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=sizeof(val) ||
+     val!=-1 || hentries_shared(shp)!=NPROCS*NKEYS)
+    exit(EXIT_FAILURE);
+  if(hget_shared(shp,(char*)&key,sizeof(key),&val,1)!=sizeof(val))
+    exit(EXIT_FAILURE);
+  if(hremove_shared(shp,(char*)&key,sizeof(key))!=0 ||
+     hremove_shared(shp,(char*)&key,sizeof(key))==0 ||
+     hget_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=-1)
+    exit(EXIT_FAILURE);
+#ifdef TSHARED_DEBUG
+  printf("[%d processes shared %lu keys]\n",NPROCS,
+	 (unsigned long)hentries_shared(shp));
+#endif
+
+  /* a writer killed at any moment leaves the table usable */
+  for(i=0; i<10; i++) {
+    if((pid=fork())==0)
+      writer();
+    pause.tv_nsec=20000000+i*1000000;
+    nanosleep(&pause,NULL);
+    kill(pid,SIGKILL);
+    waitpid(pid,&status,0);
+    key=NPROCS*NKEYS+i;
+    val=i;
+    if(hput_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=0 ||
+       hget_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=sizeof(val) ||
+       val!=i)
+      exit(EXIT_FAILURE);
+  }
+  hclose_shared(shp);
+  if(hunlink_shared(name)!=0)
+    exit(EXIT_FAILURE);
+
+  /* a creator that died before setting the table up, whether before
+     or after sizing it, is taken over */
+  for(i=0; i<2; i++) {
+    if((fd=shm_open(name,O_RDWR|O_CREAT|O_EXCL,0600))<0)
+      exit(EXIT_FAILURE);
+    if(i==1 && ftruncate(fd,BYTES)!=0)
+      exit(EXIT_FAILURE);
+    close(fd);
+    if((shp=hopen_shared(name,HSIZE,BYTES))==NULL)
+      exit(EXIT_FAILURE);
+    key=1;
+    val=2;
+    if(hput_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=0 ||
+       hget_shared(shp,(char*)&key,sizeof(key),&val,sizeof(val))!=sizeof(val) ||
+       val!=2)
+      exit(EXIT_FAILURE);
+    hclose_shared(shp);
+    hunlink_shared(name);
+  }
+
+  /* a table resized behind its back is not trusted */
+  if((shp=hopen_shared(name,HSIZE,BYTES))==NULL)
+    exit(EXIT_FAILURE);
+  hclose_shared(shp);
+  if((fd=shm_open(name,O_RDWR,0600))<0 || ftruncate(fd,2*BYTES)!=0)
+    exit(EXIT_FAILURE);
+  close(fd);
+  if(hopen_shared(name,HSIZE,BYTES)!=NULL)
+    exit(EXIT_FAILURE);
+  hunlink_shared(name);
+  return(EXIT_SUCCESS);
+}
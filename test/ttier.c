@@ -0,0 +1,161 @@
+/*
+ * ttier.c -- regression test for the tiered table module
+ */
+#define _XOPEN_SOURCE 700	/* for setrlimit */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include <tier.h>
+
+#define TTIER_DEBUG 1
+
+#define NKEYS 20000		/* keys put */
+#define MAXHOT (64*1024)	/* bytes of them kept in memory */
+#define VALSIZE(k) (8 + (k)%56)	/* bytes in the value of key k */
+#define MAXFILE (256*1024)	/* bytes a file may grow to, when full */
+
+/* the value of key k: its bytes are k's low byte plus its version */
+static void make_value(char *buf, int k, int version) {
+  memset(buf, (k + version) & 0xff, VALSIZE(k));
+}
+
+static void check_value(tier_t *tp, int k, int version) {
+  char buf[64], expect[64];
+
+  if(tiget(tp,(char*)&k,sizeof(k),buf,sizeof(buf))!=VALSIZE(k))
+    exit(EXIT_FAILURE);
+  make_value(expect,k,version);
+  if(memcmp(buf,expect,VALSIZE(k))!=0)
+    exit(EXIT_FAILURE);
+}
+
+static void put_value(tier_t *tp, int k, int version) {
+  char buf[64];
+
+  make_value(buf,k,version);
+  if(tiput(tp,(char*)&k,sizeof(k),buf,VALSIZE(k))!=0)
+    exit(EXIT_FAILURE);
+}
+
+int main(void) {
+  tier_t *tp;
+  tistats_t st;
+  struct rlimit limit,full;
+  uint64_t filebytes,stranded;
+  char buf[64];
+  int k;
+
+  if((tp=tiopen("ttier.cold",NKEYS/10,MAXHOT))==NULL)
+    exit(EXIT_FAILURE);
+
+  /* most of what is put is demoted; memory stays within its limit */
+  for(k=0; k<NKEYS; k++)
+    put_value(tp,k,0);
+  tistats(tp,&st);
+  if(st.hotbytes>MAXHOT || st.hot+st.cold!=NKEYS || st.cold<NKEYS/2 ||
+     st.demotions!=st.cold || st.lost!=0)
+    exit(EXIT_FAILURE);
+
+  /* every key reads back, the cold ones being promoted */
+  for(k=0; k<NKEYS; k++)
+    check_value(tp,k,0);
+  tistats(tp,&st);
+  if(st.hotbytes>MAXHOT || st.hot+st.cold!=NKEYS || st.promotions<NKEYS/2)
+    exit(EXIT_FAILURE);
+  /* a hot key is served from memory */
+  k=NKEYS-1;
+  check_value(tp,k,0);
+  tistats(tp,&st);
+  filebytes=st.promotions;
+  check_value(tp,k,0);
+  tistats(tp,&st);
+  if(st.promotions!=filebytes)
+    exit(EXIT_FAILURE);
+  /* a short buffer gets the start of the value */
+  if(tiget(tp,(char*)&k,sizeof(k),buf,1)!=VALSIZE(k))
+    exit(EXIT_FAILURE);
+
+  /* replace every other key, remove every third */
+  for(k=0; k<NKEYS; k+=2)
+    put_value(tp,k,1);
+  for(k=0; k<NKEYS; k+=3)
+    if(tiremove(tp,(char*)&k,sizeof(k))!=0)
+      exit(EXIT_FAILURE);
+  k=0;
+  if(tiremove(tp,(char*)&k,sizeof(k))==0 ||
+     tiget(tp,(char*)&k,sizeof(k),buf,sizeof(buf))!=-1)
+    exit(EXIT_FAILURE);
+
+  /* compaction, in steps, reclaims all the dead space */
+  tistats(tp,&st);
+  filebytes=st.filebytes;
+  while(ticompact(tp,4096)>0)
+    ;
+  tistats(tp,&st);
+  if(st.deadbytes!=0 || st.filebytes>=filebytes ||
+     st.hot+st.cold!=NKEYS-(NKEYS+2)/3)
+    exit(EXIT_FAILURE);
+  for(k=0; k<NKEYS; k++) {
+    if(k%3==0) {
+      if(tiget(tp,(char*)&k,sizeof(k),buf,sizeof(buf))!=-1)
+	exit(EXIT_FAILURE);
+    }
+    else
+      check_value(tp,k,k%2==0 ? 1 : 0);
+  }
+#ifdef TTIER_DEBUG
+  printf("[%lu hot, %lu cold in %lu bytes; %lu demotions, %lu promotions]\n",
+	 (unsigned long)st.hot,(unsigned long)st.cold,
+	 (unsigned long)st.filebytes,(unsigned long)st.demotions,
+	 (unsigned long)st.promotions);
+#endif
+
+  /* churn: demotions compact as they go, keeping the file bounded */
+  for(k=0; k<20*NKEYS; k++)
+    put_value(tp,k%NKEYS,k/NKEYS);
+  tistats(tp,&st);
+  if(st.hot+st.cold!=NKEYS || st.hotbytes>MAXHOT ||
+     st.deadbytes>st.filebytes-st.deadbytes+(1<<17))
+    exit(EXIT_FAILURE);
+  for(k=0; k<NKEYS; k++)
+    check_value(tp,k,19);
+  ticlose(tp);
+
+  /* with the files unable to grow, evicted entries stay in memory and
+   * none are lost; once there is room again they are demoted
+   */
+  if((tp=tiopen("ttier.cold",NKEYS/10,MAXHOT))==NULL)
+    exit(EXIT_FAILURE);
+  signal(SIGXFSZ,SIG_IGN);	/* a full file fails, not kills */
+  getrlimit(RLIMIT_FSIZE,&limit);
+  full=limit;
+  full.rlim_cur=MAXFILE;
+  if(setrlimit(RLIMIT_FSIZE,&full)!=0)
+    exit(EXIT_FAILURE);
+  for(k=0; k<NKEYS; k++)
+    put_value(tp,k,0);
+  tistats(tp,&st);
+  if(st.stranded==0 || st.lost!=0 || st.hot+st.cold!=NKEYS)
+    exit(EXIT_FAILURE);
+  stranded=st.stranded;
+  for(k=0; k<NKEYS; k++)
+    check_value(tp,k,0);
+  if(setrlimit(RLIMIT_FSIZE,&limit)!=0)
+    exit(EXIT_FAILURE);
+  put_value(tp,0,1);
+  tistats(tp,&st);
+  if(st.stranded!=0 || st.hotbytes>MAXHOT || st.hot+st.cold!=NKEYS)
+    exit(EXIT_FAILURE);
+  for(k=0; k<NKEYS; k++)
+    check_value(tp,k,k==0 ? 1 : 0);
+#ifdef TTIER_DEBUG
+  printf("[%lu entries stranded by a full file, none lost]\n",
+	 (unsigned long)stranded);
+#endif
+  ticlose(tp);
+  return(EXIT_SUCCESS);
+}
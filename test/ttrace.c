@@ -0,0 +1,94 @@
+/*
+ * ttrace.c -- regression test for the latency tracing module; built
+ * without -DTRACE it checks the probes cost nothing and record nothing
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hash.h>
+#include <queue.h>
+#include <trace.h>
+#include <tutils.h>
+
+#define NOPS 10000		/* operations of each kind made */
+#define EVERY 10		/* sampling rate of the second pass */
+
+static uint64_t calls[TR_NOPS];	/* latencies seen by the callback */
+static uint64_t longest[TR_NOPS]; /* and the longest of them */
+
+static void count_call(trace_op_t op, uint64_t cycles) {
+  calls[op]++;
+  if(cycles>longest[op])
+    longest[op]=cycles;
+}
+
+/* make NOPS puts, searches and removes on a table */
+static void run_ops(void) {
+  hashtable_t *ht;
+  int key;
+
+  ht=hopen(NOPS/10);
+  for(key=0; key<NOPS; key++)
+    if(hput(ht,make_person("traced",key,SALARY),(char*)&key,sizeof(key))!=0)
+      exit(EXIT_FAILURE);
+  for(key=0; key<NOPS; key++)
+    check_person(hsearch(ht,is_age,(char*)&key,sizeof(key)),"traced",key);
+  for(key=0; key<NOPS; key++)
+    free_person(hremove(ht,is_age,(char*)&key,sizeof(key)));
+  hclose(ht);
+}
+
+int main(void) {
+  trace_op_t op;
+  uint64_t expect;
+
+  /* time every operation */
+  tsetsampling(1);
+  tsetcallback(count_call);
+  run_ops();
+  tdump(stdout);
+#ifdef TRACE
+  expect=NOPS;
+#else
+  expect=0;
+#endif
+  if(tcount(TR_HPUT)!=expect || tcount(TR_HSEARCH)!=expect ||
+     tcount(TR_HREMOVE)!=expect)
+    exit(EXIT_FAILURE);
+  if(tcount(TR_QPUT)!=expect || tcount(TR_QSEARCH)!=expect)
+    exit(EXIT_FAILURE);
+  for(op=0; op<TR_NOPS; op++) {
+    if(calls[op]!=tcount(op))
+      exit(EXIT_FAILURE);
+    if(tpercentile(op,0.5)>tpercentile(op,0.99) ||
+       tpercentile(op,0.99)>tpercentile(op,1.0))
+      exit(EXIT_FAILURE);
+    if(expect>0 && tpercentile(op,1.0)==0 && tcount(op)>0)
+      exit(EXIT_FAILURE);
+    /* the top bucket holds the longest latency, to within 1/8 */
+    if(tpercentile(op,1.0)>longest[op] ||
+       tpercentile(op,1.0)<longest[op]-longest[op]/8)
+      exit(EXIT_FAILURE);
+  }
+
+  /* time one in EVERY, after forgetting the first pass */
+  treset();
+  tsetcallback(NULL);
+  tsetsampling(EVERY);
+  run_ops();
+  if(tcount(TR_HPUT)!=expect/EVERY || tcount(TR_HSEARCH)!=expect/EVERY)
+    exit(EXIT_FAILURE);
+  if(calls[TR_HPUT]!=expect)	/* callback removed */
+    exit(EXIT_FAILURE);
+
+  /* and none */
+  treset();
+  tsetsampling(0);
+  run_ops();
+  for(op=0; op<TR_NOPS; op++)
+    if(tcount(op)!=0)
+      exit(EXIT_FAILURE);
+  return(EXIT_SUCCESS);
+}
@@ -0,0 +1,152 @@
+/*
+ * ttwheel.c -- regression test for the timing wheel module
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hash.h>
+#include <twheel.h>
+#include <tutils.h>
+
+#define TWHEEL_DEBUG 1
+
+#define NTIMERS 10000		/* timers scheduled */
+#define SPREAD 100000		/* ticks they are spread over */
+
+static twheel_t *wheel;
+static uint64_t fired[NTIMERS];	/* tick each timer expired on */
+static int nfired;
+
+/* the elements are indices into fired */
+static void record(void *ep) {
+  fired[*(int*)ep]=twnow(wheel);
+  nfired++;
+  free(ep);
+}
+
+static int *make_index(int i) {
+  int *ip;
+
+  if((ip=malloc(sizeof(int)))==NULL)
+    exit(EXIT_FAILURE);
+  *ip=i;
+  return ip;
+}
+
+/* the delay of timer i; scattered, with some far in the future */
+static uint64_t delay_of(int i) {
+  if(i%100==0)
+    return ((uint64_t)1 << (20+i%40)) + i;
+  return (uint64_t)(i*7919)%SPREAD + 1;
+}
+
+int main(void) {
+  twtimer_t *timers[NTIMERS];
+  hashtable_t *ht;
+  void *pp;
+  uint64_t t,n;
+  int i,key;
+
+  /* every timer expires on exactly its tick */
+  wheel=twopen(record);
+  for(i=0; i<NTIMERS; i++)
+    if((timers[i]=twput(wheel,make_index(i),delay_of(i)))==NULL)
+      exit(EXIT_FAILURE);
+  /* cancel every third one */
+  for(i=0; i<NTIMERS; i+=3)
+    free(twcancel(wheel,timers[i]));
+  if(twpending(wheel)!=NTIMERS-(NTIMERS+2)/3)
+    exit(EXIT_FAILURE);
+  for(t=0; t<SPREAD; t++)
+    twadvance(wheel,1,0);
+  /* far ones, by jumping straight to each */
+  while(twpending(wheel)>0) {
+    for(t=UINT64_MAX, i=0; i<NTIMERS; i++)
+      if(i%3!=0 && fired[i]==0 && delay_of(i)<t)
+	t=delay_of(i);
+    twadvance(wheel,t-twnow(wheel),0);
+  }
+  for(i=0; i<NTIMERS; i++)
+    if(fired[i]!=(i%3==0 ? 0 : delay_of(i)))
+      exit(EXIT_FAILURE);
+#ifdef TWHEEL_DEBUG
+  printf("[%d timers expired on time]\n",nfired);
+#endif
+
+  /* a budget spreads a burst of expiries over several calls */
+  nfired=0;
+  memset(fired,0,sizeof(fired));
+  for(i=0; i<NTIMERS; i++)
+    if(twput(wheel,make_index(i),10)==NULL)
+      exit(EXIT_FAILURE);
+  t=twnow(wheel);
+  for(n=0; twpending(wheel)>0; n++)
+    if(twadvance(wheel,n==0 ? 100 : 0,NTIMERS/10)>NTIMERS/10)
+      exit(EXIT_FAILURE);
+  if(nfired!=NTIMERS || n!=10)
+    exit(EXIT_FAILURE);
+  for(i=0; i<NTIMERS; i++)
+    if(fired[i]!=t+100)	/* the clock, not the tick they fell due on */
+      exit(EXIT_FAILURE);
+  twclose(wheel);
+
+  /* entries put with a time to live leave the table */
+  wheel=twopen(free_person);
+  ht=hopen(NTIMERS/10);
+  for(key=0; key<NTIMERS; key++)
+    if(twhput(wheel,ht,make_person("mortal",key,SALARY),
+	      (char*)&key,sizeof(key),key%100+1)==NULL)
+      exit(EXIT_FAILURE);
+  key=NTIMERS-1;		/* (lives for 100 ticks) */
+  free_person(hremove(ht,is_age,(char*)&key,sizeof(key)));
+  for(t=1; t<=100; t++) {
+    twadvance(wheel,1,0);
+    for(key=0; key<NTIMERS; key++) {
+      if(hsearch(ht,is_age,(char*)&key,sizeof(key))==NULL) {
+	if((uint64_t)(key%100+1)>t && key!=NTIMERS-1)
+	  exit(EXIT_FAILURE);
+      }
+      else if((uint64_t)(key%100+1)<=t)
+	exit(EXIT_FAILURE);
+    }
+  }
+  if(twpending(wheel)!=0)
+    exit(EXIT_FAILURE);
+
+  /* an entry taken out with twhremove has no timer left to expire
+   * whatever is put under its key next
+   */
+  key=0;
+  timers[0]=twhput(wheel,ht,make_person("first",key,SALARY),
+		   (char*)&key,sizeof(key),10);
+  if(timers[0]==NULL)
+    exit(EXIT_FAILURE);
+  pp=twhremove(wheel,timers[0]);
+  check_person(pp,"first",key);
+  free_person(pp);
+  if(twpending(wheel)!=0 || hsearch(ht,is_age,(char*)&key,sizeof(key))!=NULL)
+    exit(EXIT_FAILURE);
+  if(hput(ht,make_person("second",key,SALARY),(char*)&key,sizeof(key))!=0)
+    exit(EXIT_FAILURE);
+  twadvance(wheel,20,0);
+  check_person(hsearch(ht,is_age,(char*)&key,sizeof(key)),"second",key);
+  /* and one already gone from the table is not found again */
+  key=1;
+  timers[0]=twhput(wheel,ht,make_person("third",key,SALARY),
+		   (char*)&key,sizeof(key),10);
+  if(timers[0]==NULL)
+    exit(EXIT_FAILURE);
+  pp=hremove(ht,is_age,(char*)&key,sizeof(key));
+  if(twhremove(wheel,timers[0])!=NULL || twpending(wheel)!=0)
+    exit(EXIT_FAILURE);
+  check_person(pp,"third",key);
+  free_person(pp);
+#ifdef TWHEEL_DEBUG
+  printf("[twhremove succeeded]\n");
+#endif
+  twclose(wheel);
+  hclose(ht);
+  return(EXIT_SUCCESS);
+}
@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <queue.h>
+#include <hash.h>
 #include <tutils.h>
 
 void* make_person(char* namep,int age,double salary) {
@@ -75,3 +76,41 @@ bool is_age(void *ep,const void *keyp) {
     return true;
   return false;
 }
+
+int search_compares;
+
+/* is_age, counting its calls in search_compares */
+bool is_age_counted(void *ep,const void *keyp) {
+  search_compares++;
+  return is_age(ep,keyp);
+}
+
+/* key function (see hsetkeyfn) giving a person's age */
+const char *age_key(void *ep,int32_t *keylenp) {
+  *keylenp=sizeof(int);
+  return (const char*)&((person_t*)ep)->age;
+}
+
+/* fill table ht with people aged lo..hi-1, named for their ages */
+hashtable_t *put_people(hashtable_t *ht,int lo,int hi) {
+  char nm[NAMESIZE];
+  int key;
+
+  for(key=lo; key<hi; key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    if(hput(ht,make_person(nm,key,SALARY),(char*)&key,sizeof(key))!=0)
+      exit(EXIT_FAILURE);
+  }
+  return ht;
+}
+
+/* check people aged lo..hi-1 are all in the table */
+void check_people(hashtable_t *ht,int lo,int hi) {
+  char nm[NAMESIZE];
+  int key;
+
+  for(key=lo; key<hi; key++) {
+    snprintf(nm,sizeof(nm),"%s%d","nm",key);
+    check_person(hsearch(ht,is_age,(char*)&key,sizeof(key)),nm,key);
+  }
+}
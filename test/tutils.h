@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <stdbool.h>
 #define NAMESIZE 256
 #define SALARY ((double)50.00) /* default salary */
@@ -17,6 +18,7 @@
  * the queue to contain any type of element
  */
 typedef void queue_t;
+typedef void hashtable_t;
 
 typedef struct person_struct {
   char name[NAMESIZE];
@@ -32,3 +34,10 @@ void print_person(void *ep);
 void get_n_check(queue_t *qp,char *s,int a);
 void check_empty(queue_t *qp);
 bool is_age(void *ep,const void *keyp);
+
+/* helpers for hash table tests, where a person's key is their age */
+extern int search_compares;	/* calls made to is_age_counted */
+bool is_age_counted(void *ep,const void *keyp);
+const char *age_key(void *ep,int32_t *keylenp);
+hashtable_t *put_people(hashtable_t *ht,int lo,int hi);
+void check_people(hashtable_t *ht,int lo,int hi);